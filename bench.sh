@@ -0,0 +1 @@
+gcc -pthread -O2 -Wall -Wextra -Wno-unused-function -I./ libs/logging/logging.c libs/io/io.c libs/alloc/alloc.c libs/pool/pool.c datastructures/list/list.c datastructures/list/compact/compact.c datastructures/list/dump/dump.c datastructures/tree/tree.c datastructures/tree/slab/slab.c datastructures/tree/iter/iter.c datastructures/tree/parallel/parallel.c datastructures/tree/concurrent/concurrent.c datastructures/tree/persistent/persistent.c datastructures/tree/frozen/frozen.c datastructures/tree/serial/serial.c datastructures/tree/dump/dump.c datastructures/btree/btree.c datastructures/radix/radix.c bench/bench.c -lm -o dist/bench.out
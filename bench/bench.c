@@ -0,0 +1,714 @@
+#include "libs/types.h"
+
+#include "datastructures/list/list.h"
+#include "datastructures/tree/tree.h"
+#include "datastructures/tree/template/tree_template.h"
+#include "datastructures/tree/iter/iter.h"
+#include "datastructures/tree/serial/serial.h"
+#include "datastructures/tree/frozen/frozen.h"
+#include "datastructures/tree/parallel/parallel.h"
+#include "datastructures/tree/concurrent/concurrent.h"
+#include "datastructures/tree/persistent/persistent.h"
+#include "datastructures/btree/btree.h"
+#include "datastructures/radix/radix.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define DEFAULT_BENCH_SIZE 1000000
+#define KEY_BUF_SIZE       24
+
+typedef enum
+{
+    STREAM_SORTED  = 0,
+    STREAM_REVERSE = 1,
+    STREAM_RANDOM  = 2,
+} stream_t;
+
+static const char *const stream_names[3] = {
+    "sorted", "reverse", "random"
+};
+
+static double now_sec()
+{
+    struct timespec ts = { 0 };
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static char* make_keys(const size_t n, const stream_t kind)
+{
+    char* keys = (char*)calloc(n, KEY_BUF_SIZE);
+    if (!keys) return NULL;
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        const size_t v = (kind == STREAM_REVERSE) ? n - 1 - i : i;
+        snprintf(keys + i * KEY_BUF_SIZE, KEY_BUF_SIZE, "%zu", v);
+    }
+
+    if (kind == STREAM_RANDOM)
+    {
+        char tmp[KEY_BUF_SIZE];
+        srand(42);
+        for (size_t i = n - 1; i > 0; --i)
+        {
+            const size_t j = ((size_t)rand() * RAND_MAX + (size_t)rand()) % (i + 1);
+            memcpy(tmp, keys + i * KEY_BUF_SIZE, KEY_BUF_SIZE);
+            memcpy(keys + i * KEY_BUF_SIZE, keys + j * KEY_BUF_SIZE, KEY_BUF_SIZE);
+            memcpy(keys + j * KEY_BUF_SIZE, tmp, KEY_BUF_SIZE);
+        }
+    }
+    return keys;
+}
+
+DEFINE_TREE(itree, int64_t, size_t, TREE_CMP_NUM)
+
+#define REPORT(what, elapsed, n) \
+    printf("  %-10s %8.1f ns/op\n", (what), (elapsed) * 1e9 / (double)(n))
+
+// Timing of a call that may fail, a failed run is not reported as a time
+#define REPORT_RC(what, rc, elapsed, n)                                   \
+    ((rc) == OK ? (void)REPORT((what), (elapsed), (n))                    \
+                : (void)printf("  %-10s   failed (%d)\n", (what), (int)(rc)))
+
+static void bench_tree_streams(const size_t n)
+{
+    printf("tree insert/find/delete, %zu keys\n", n);
+
+    for (int kind = STREAM_SORTED; kind <= STREAM_RANDOM; ++kind)
+    {
+        char* keys = make_keys(n, (stream_t)kind);
+        if (!keys) return;
+
+        CREATE_TREE(tree);
+        printf(" %s:\n", stream_names[kind]);
+
+        double start = now_sec();
+        for (size_t i = 0; i < n; ++i) tree_insert(&tree, keys + i * KEY_BUF_SIZE);
+        REPORT("insert", now_sec() - start, n);
+        printf("  %-10s %8d\n", "height", tree.root ? tree.root->height : 0);
+
+        node_t* found = NULL;
+        start = now_sec();
+        for (size_t i = 0; i < n; ++i) tree_find(&tree, keys + i * KEY_BUF_SIZE, &found);
+        REPORT("find", now_sec() - start, n);
+
+        start = now_sec();
+        for (size_t i = 0; i < n; ++i) tree_delete(&tree, keys + i * KEY_BUF_SIZE);
+        REPORT("delete", now_sec() - start, n);
+
+        tree_dtor(&tree);
+        free(keys);
+    }
+}
+
+static void bench_tree_bulk(const size_t n)
+{
+    printf("tree bulk load, %zu keys\n", n);
+
+    for (int kind = STREAM_SORTED; kind <= STREAM_RANDOM; kind += 2)
+    {
+        char*        keys = make_keys(n, (stream_t)kind);
+        const char** ptrs = (const char**)calloc(n, sizeof(char*));
+        if (!keys || !ptrs) { free(keys); free(ptrs); return; }
+        for (size_t i = 0; i < n; ++i) ptrs[i] = keys + i * KEY_BUF_SIZE;
+
+        CREATE_TREE(tree);
+        printf(" %s:\n", stream_names[kind]);
+
+        const double start = now_sec();
+        tree_build_from_array(&tree, ptrs, n);
+        const double elapsed = now_sec() - start;
+        REPORT("build", elapsed, n);
+        printf("  %-10s %8.1f ms\n", "total", elapsed * 1e3);
+        printf("  %-10s %8d\n", "height", tree.root ? tree.root->height : 0);
+
+        tree_dtor(&tree);
+        free(ptrs);
+        free(keys);
+    }
+}
+
+static void bench_tree_frozen(const size_t n)
+{
+    printf("tree vs frozen lookup, %zu keys\n", n);
+
+    char*        keys = make_keys(n, STREAM_RANDOM);
+    const char** ptrs = (const char**)calloc(n, sizeof(char*));
+    if (!keys || !ptrs) { free(keys); free(ptrs); return; }
+    for (size_t i = 0; i < n; ++i) ptrs[i] = keys + i * KEY_BUF_SIZE;
+
+    CREATE_TREE(tree);
+    tree_build_from_array(&tree, ptrs, n);
+
+    tree_frozen_t frozen = { 0 };
+    double start = now_sec();
+    tree_freeze(&tree, &frozen);
+    REPORT("freeze", now_sec() - start, n);
+
+    node_t* found = NULL;
+    start = now_sec();
+    for (size_t i = 0; i < n; ++i) tree_find(&tree, ptrs[i], &found);
+    REPORT("find", now_sec() - start, n);
+
+    size_t slot = 0;
+    start = now_sec();
+    for (size_t i = 0; i < n; ++i) tree_frozen_find(&frozen, ptrs[i], &slot);
+    REPORT("frozen", now_sec() - start, n);
+
+    start = now_sec();
+    for (size_t i = 0; i < n; ++i) tree_lower_bound(&tree, ptrs[i], &found);
+    REPORT("lower", now_sec() - start, n);
+
+    start = now_sec();
+    for (size_t i = 0; i < n; ++i) tree_frozen_lower_bound(&frozen, ptrs[i], &slot);
+    REPORT("frz lower", now_sec() - start, n);
+
+    tree_frozen_dtor(&frozen);
+    tree_dtor(&tree);
+    free(ptrs);
+    free(keys);
+}
+
+static void bench_tree_batch(const size_t n)
+{
+    printf("tree batched lookups, %zu keys inserted in random order\n", n);
+
+    char*        keys  = make_keys(n, STREAM_RANDOM);
+    const char** ptrs  = (const char**)calloc(n, sizeof(char*));
+    node_t**     found = (node_t**)calloc(n, sizeof(node_t*));
+    if (!keys || !ptrs || !found) { free(keys); free(ptrs); free(found); return; }
+    for (size_t i = 0; i < n; ++i) ptrs[i] = keys + i * KEY_BUF_SIZE;
+
+    CREATE_TREE(tree);
+    for (size_t i = 0; i < n; ++i) tree_insert(&tree, keys + i * KEY_BUF_SIZE);
+
+    // Probe in a different order than the inserts
+    for (size_t i = 0; i + 1 < n; i += 2)
+    {
+        const char* tmp = ptrs[i];
+        ptrs[i]         = ptrs[n - 1 - i];
+        ptrs[n - 1 - i] = tmp;
+    }
+
+    double start = now_sec();
+    for (size_t i = 0; i < n; ++i) tree_find(&tree, ptrs[i], &found[i]);
+    REPORT("find", now_sec() - start, n);
+
+    const size_t batches[] = { 32, 256, 1024 };
+    for (size_t b = 0; b < sizeof(batches) / sizeof(*batches); ++b)
+    {
+        char label[16];
+        snprintf(label, sizeof(label), "batch %zu", batches[b]);
+
+        start = now_sec();
+        for (size_t i = 0; i < n; i += batches[b])
+            tree_find_batch(&tree, ptrs + i, (n - i < batches[b]) ? n - i : batches[b], found + i);
+        REPORT(label, now_sec() - start, n);
+    }
+
+    tree_dtor(&tree);
+    free(found);
+    free(ptrs);
+    free(keys);
+}
+
+static void bench_list_batch(const size_t n)
+{
+    const size_t hops = 16;
+    printf("list batched walks, %zu elements linked in random order, %zu hops\n", n, hops);
+
+    CREATE_LIST(list);
+    size_t* from = (size_t*)calloc(n, sizeof(size_t));
+    size_t* out  = (size_t*)calloc(n, sizeof(size_t));
+    if (!from || !out) { free(from); free(out); list_dtor(&list); return; }
+
+    // Element i lands at slot i + 1, linked after a random earlier one
+    size_t index = 0;
+    push_back(&list, 0, &index);
+    srand(7);
+    for (size_t i = 1; i < n; ++i)
+        ins_elem_after(&list, 1 + (size_t)rand() % i, (list_elem_t)i);
+    for (size_t i = 0; i < n; ++i)
+        from[i] = 1 + (size_t)rand() % n;
+
+    size_t tail = 0;
+    get_tail(&list, &tail);
+
+    double start = now_sec();
+    for (size_t i = 0; i < n; ++i)
+    {
+        size_t cur = from[i];
+        for (size_t h = 0; h < hops && cur != 0; ++h)
+        {
+            if (cur == tail) cur = 0;
+            else get_next(&list, cur, &cur);
+        }
+        out[i] = cur;
+    }
+    REPORT("get_next", (now_sec() - start) / hops, n);
+
+    const size_t batches[] = { 32, 256, 1024 };
+    for (size_t b = 0; b < sizeof(batches) / sizeof(*batches); ++b)
+    {
+        char label[16];
+        snprintf(label, sizeof(label), "batch %zu", batches[b]);
+
+        start = now_sec();
+        for (size_t i = 0; i < n; i += batches[b])
+            list_walk_batch(&list, from + i, hops, (n - i < batches[b]) ? n - i : batches[b], out + i);
+        REPORT(label, (now_sec() - start) / hops, n);
+    }
+
+    list_dtor(&list);
+    free(from);
+    free(out);
+}
+
+// Text form of tree_print in one buffer
+static char* print_tree(const tree_t * const tree, size_t * const size)
+{
+    size_t capacity = 64 + tree->nodes_amount * (KEY_BUF_SIZE + 4);
+    char*  text     = (char*)malloc(capacity);
+    if (!text) return NULL;
+
+    tree_iter_t it;
+    tree_iter_begin(&it, tree, TREE_EULER);
+
+    size_t used = 0;
+    const node_t* cur = NULL;
+    while ((cur = tree_iter_next(&it)) != NULL)
+    {
+        if      (it.visit == TREE_PREORDER) text[used++] = '(';
+        else if (it.visit == TREE_INORDER)  used += (size_t)sprintf(text + used, "\"%s\"", node_data(cur));
+        else                                text[used++] = ')';
+    }
+    tree_iter_end(&it);
+
+    *size = used;
+    return text;
+}
+
+static void bench_tree_load(const size_t n)
+{
+    printf("tree write and load, %zu keys\n", n);
+
+    char* keys = make_keys(n, STREAM_RANDOM);
+    if (!keys) return;
+
+    CREATE_TREE(tree);
+    for (size_t i = 0; i < n; ++i) tree_insert(&tree, keys + i * KEY_BUF_SIZE);
+
+    size_t size = 0;
+    char*  text = print_tree(&tree, &size);
+    if (!text) { tree_dtor(&tree); free(keys); return; }
+
+    CREATE_TREE(loaded);
+    double start   = now_sec();
+    tree_load_buffer(&loaded, text, size);
+    double elapsed = now_sec() - start;
+
+    REPORT("load", elapsed, n);
+    printf("  %-10s %8.1f MB/s\n", "throughput", (double)size / elapsed / 1e6);
+
+    FILE* file = tmpfile();
+    if (file)
+    {
+        // What tree_print_node did before: one stdio call per token
+        tree_iter_t it;
+        tree_iter_begin(&it, &tree, TREE_EULER);
+        const node_t* cur = NULL;
+        start = now_sec();
+        while ((cur = tree_iter_next(&it)) != NULL)
+        {
+            if      (it.visit == TREE_PREORDER) fprintf(file, "(");
+            else if (it.visit == TREE_INORDER)  fprintf(file, "\"%s\"", node_data(cur));
+            else                                fprintf(file, ")");
+        }
+        fflush(file);
+        REPORT("fprintf", now_sec() - start, n);
+        tree_iter_end(&it);
+
+        const tree_format_t formats[2] = { TREE_FORMAT_TEXT, TREE_FORMAT_BINARY };
+        const char* const   names  [2] = { "write txt", "write bin" };
+        for (size_t f = 0; f < 2; ++f)
+        {
+            rewind(file);
+            tree_sink_t sink;
+            tree_sink_fd(&sink, fileno(file), NULL, 0);
+
+            start = now_sec();
+            tree_write(&tree, &sink, formats[f]);
+            elapsed = now_sec() - start;
+            REPORT(names[f], elapsed, n);
+            printf("  %-10s %8.1f MB/s\n", "throughput", (double)sink.written / elapsed / 1e6);
+        }
+
+        rewind(file);
+        start = now_sec();
+        tree_load(&loaded, file);
+        REPORT("load bin", now_sec() - start, n);
+        fclose(file);
+    }
+
+    tree_dtor(&loaded);
+    tree_dtor(&tree);
+    free(text);
+    free(keys);
+}
+
+static int64_t key_value(const node_t * const node, void * const ctx)
+{
+    unused ctx;
+    return node->key.num;
+}
+
+static int64_t sum(const int64_t a, const int64_t b)
+{
+    return a + b;
+}
+
+static err_t sum_visit(node_t * const node, void * const ctx)
+{
+    *(int64_t*)ctx += node->key.num;
+    return OK;
+}
+
+static void bench_tree_linearize(const size_t n)
+{
+    printf("tree linearize on a fragmented slab, %zu keys\n", n);
+
+    char* keys = make_keys(n, STREAM_RANDOM);
+    if (!keys) return;
+
+    // Random insert order, then half of the nodes recycled through the free list
+    CREATE_TREE(tree);
+    for (size_t i = 0; i < n; ++i)     tree_insert(&tree, keys + i * KEY_BUF_SIZE);
+    for (size_t i = 0; i < n; i += 2)  tree_delete(&tree, keys + ((i * 7919) % n) * KEY_BUF_SIZE);
+    for (size_t i = 0; i < n; i += 2)  tree_insert(&tree, keys + ((i * 7919) % n) * KEY_BUF_SIZE);
+
+    const tree_order_t orders[3] = { 0, TREE_PREORDER, TREE_LEVELORDER };
+    const char* const  names [3] = { "scattered", "preorder", "levelorder" };
+
+    for (size_t o = 0; o < 3; ++o)
+    {
+        printf(" %s:\n", names[o]);
+        if (orders[o] != 0)
+        {
+            const double start = now_sec();
+            tree_linearize(&tree, orders[o]);
+            REPORT("linearize", now_sec() - start, n);
+        }
+
+        int64_t total = 0;
+        double start = now_sec();
+        tree_foreach(&tree, sum_visit, &total);
+        REPORT("foreach", now_sec() - start, n);
+
+        node_t* found = NULL;
+        start = now_sec();
+        for (size_t i = 0; i < n; ++i) tree_find(&tree, keys + i * KEY_BUF_SIZE, &found);
+        REPORT("find", now_sec() - start, n);
+    }
+
+    tree_dtor(&tree);
+    free(keys);
+}
+
+static void bench_tree_parallel(const size_t n)
+{
+    pool_t pool = { 0 };
+    if (pool_ctor(&pool, 0, NULL) != OK) return;
+    printf("tree parallel ops, %zu keys, %zu workers\n", n, pool.workers_amount);
+
+    char*        keys = make_keys(n, STREAM_RANDOM);
+    const char** ptrs = (const char**)calloc(n, sizeof(char*));
+    if (!keys || !ptrs) { free(keys); free(ptrs); pool_dtor(&pool); return; }
+    for (size_t i = 0; i < n; ++i) ptrs[i] = keys + i * KEY_BUF_SIZE;
+
+    CREATE_TREE(tree);
+    tree_build_from_array(&tree, ptrs, n);
+
+    int64_t total = 0;
+    double start = now_sec();
+    tree_foreach(&tree, sum_visit, &total);
+    REPORT("foreach", now_sec() - start, n);
+
+    start = now_sec();
+    tree_par_map_reduce(&tree, &pool, key_value, sum, 0, NULL, &total);
+    REPORT("map/reduce", now_sec() - start, n);
+
+    start = now_sec();
+    err_t rc = tree_verify(&tree);
+    REPORT_RC("verify", rc, now_sec() - start, n);
+
+    start = now_sec();
+    rc = tree_par_verify(&tree, &pool);
+    REPORT_RC("par verify", rc, now_sec() - start, n);
+
+    tree_stats_t stats;
+    start = now_sec();
+    tree_stats(&tree, &stats);
+    REPORT("stats", now_sec() - start, n);
+    printf("  height %d (%.2f of log2 n), mean depth %.2f, %zu leaves, %.1f slab B/key (%zu overhead)\n",
+           stats.height, stats.height_ratio, stats.mean_depth, stats.leaves,
+           (double)stats.slab_bytes / n, stats.overhead_bytes);
+
+    start = now_sec();
+    tree_par_clear(&tree, &pool);
+    REPORT("clear", now_sec() - start, n);
+
+    tree_dtor(&tree);
+    pool_dtor(&pool);
+    free(ptrs);
+    free(keys);
+}
+
+typedef struct
+{
+    ctree_t*            tree;
+    const char* const*  keys;
+    size_t              n;
+    atomic_bool*        stop;
+} ctree_job_t;
+
+static void* ctree_reader(void* arg)
+{
+    ctree_job_t* job = (ctree_job_t*)arg;
+    ctree_reader_t reader;
+    if (ctree_reader_register(job->tree, &reader) != OK) return NULL;
+
+    const node_t* found = NULL;
+    for (size_t i = 0; i < job->n; i += 64)
+    {
+        ctree_read_lock(&reader);
+        for (size_t j = i; j < i + 64 && j < job->n; ++j) ctree_find(job->tree, job->keys[j], &found);
+        ctree_read_unlock(&reader);
+    }
+
+    ctree_reader_unregister(&reader);
+    return NULL;
+}
+
+static void* ctree_writer(void* arg)
+{
+    ctree_job_t* job = (ctree_job_t*)arg;
+    for (size_t i = 0; !atomic_load(job->stop); i = (i + 1) % job->n)
+    {
+        ctree_delete(job->tree, job->keys[i]);
+        ctree_insert(job->tree, job->keys[i]);
+    }
+    return NULL;
+}
+
+static void bench_tree_concurrent(const size_t n)
+{
+    printf("concurrent tree lookups with one writer, %zu keys\n", n);
+
+    char*        keys = make_keys(n, STREAM_RANDOM);
+    const char** ptrs = (const char**)calloc(n, sizeof(char*));
+    if (!keys || !ptrs) { free(keys); free(ptrs); return; }
+    for (size_t i = 0; i < n; ++i) ptrs[i] = keys + i * KEY_BUF_SIZE;
+
+    ctree_t tree;
+    ctree_ctor(&tree, NULL);
+    for (size_t i = 0; i < n; ++i) ctree_insert(&tree, ptrs[i]);
+
+    for (size_t threads = 1; threads <= 4; threads *= 2)
+    {
+        atomic_bool stop = false;
+        ctree_job_t job  = { &tree, ptrs, n, &stop };
+        pthread_t   readers[4];
+        pthread_t   writer;
+
+        pthread_create(&writer, NULL, ctree_writer, &job);
+        const double start = now_sec();
+        for (size_t t = 0; t < threads; ++t) pthread_create(&readers[t], NULL, ctree_reader, &job);
+        for (size_t t = 0; t < threads; ++t) pthread_join(readers[t], NULL);
+        const double elapsed = now_sec() - start;
+        atomic_store(&stop, true);
+        pthread_join(writer, NULL);
+
+        char what[16];
+        snprintf(what, sizeof(what), "%zu readers", threads);
+        REPORT(what, elapsed, n * threads);
+    }
+
+    ctree_dtor(&tree);
+    free(ptrs);
+    free(keys);
+}
+
+static void bench_tree_persistent(const size_t n)
+{
+    printf("persistent tree versions, %zu keys\n", n);
+
+    char* keys = make_keys(n, STREAM_RANDOM);
+    if (!keys) return;
+
+    CREATE_PTREE(tree);
+    CREATE_PTREE(snapshot);
+
+    double start = now_sec();
+    for (size_t i = 0; i < n; ++i) ptree_insert(&tree, keys + i * KEY_BUF_SIZE, &tree);
+    REPORT("insert", now_sec() - start, n);
+
+    start = now_sec();
+    for (size_t i = 0; i < n; ++i) ptree_snapshot(&tree, &snapshot);
+    REPORT("snapshot", now_sec() - start, n);
+
+    const pnode_t* found = NULL;
+    start = now_sec();
+    for (size_t i = 0; i < n; ++i) ptree_find(&snapshot, keys + i * KEY_BUF_SIZE, &found);
+    REPORT("find", now_sec() - start, n);
+
+    // Every delete copies a path the snapshot still shares
+    start = now_sec();
+    for (size_t i = 0; i < n; ++i) ptree_delete(&tree, keys + i * KEY_BUF_SIZE, &tree);
+    REPORT("delete", now_sec() - start, n);
+
+    ptree_dtor(&snapshot);
+    ptree_dtor(&tree);
+    free(keys);
+}
+
+static void bench_typed_tree(const size_t n)
+{
+    printf("typed int64 tree insert/find/delete, %zu keys\n", n);
+
+    char* keys = make_keys(n, STREAM_RANDOM);
+    if (!keys) return;
+
+    int64_t* nums = (int64_t*)calloc(n, sizeof(int64_t));
+    if (!nums) { free(keys); return; }
+    for (size_t i = 0; i < n; ++i) nums[i] = strtoll(keys + i * KEY_BUF_SIZE, NULL, 10);
+
+    itree_t tree = { 0 };
+    itree_ctor(&tree, NULL);
+
+    double start = now_sec();
+    for (size_t i = 0; i < n; ++i) itree_insert(&tree, nums[i], i);
+    REPORT("insert", now_sec() - start, n);
+    printf("  %-10s %8d\n", "height", tree.root ? tree.root->height : 0);
+
+    size_t value = 0;
+    start = now_sec();
+    for (size_t i = 0; i < n; ++i) itree_find(&tree, nums[i], &value);
+    REPORT("find", now_sec() - start, n);
+
+    start = now_sec();
+    for (size_t i = 0; i < n; ++i) itree_delete(&tree, nums[i]);
+    REPORT("delete", now_sec() - start, n);
+
+    itree_dtor(&tree);
+    free(nums);
+    free(keys);
+}
+
+static void bench_btree(const size_t n)
+{
+    printf("btree int64 insert/find/delete, %zu keys\n", n);
+
+    char* keys = make_keys(n, STREAM_RANDOM);
+    if (!keys) return;
+
+    int64_t* nums = (int64_t*)calloc(n, sizeof(int64_t));
+    if (!nums) { free(keys); return; }
+    for (size_t i = 0; i < n; ++i) nums[i] = strtoll(keys + i * KEY_BUF_SIZE, NULL, 10);
+
+    CREATE_BTREE(tree);
+
+    double start = now_sec();
+    for (size_t i = 0; i < n; ++i) btree_insert(&tree, nums[i], i);
+    REPORT("insert", now_sec() - start, n);
+    printf("  %-10s %8zu\n", "height", tree.height);
+    printf("  %-10s %8.1f B/key\n", "memory",
+           (double)(tree.nodes_amount * BTREE_NODE_BYTES) / (double)(n ? n : 1));
+
+    btree_value_t value = 0;
+    start = now_sec();
+    for (size_t i = 0; i < n; ++i) btree_find(&tree, nums[i], &value);
+    REPORT("find", now_sec() - start, n);
+
+    btree_cursor_t cursor;
+    size_t visited = 0;
+    start = now_sec();
+    for (btree_first(&tree, &cursor); btree_cursor_valid(&cursor); btree_cursor_next(&cursor))
+        visited++;
+    REPORT("scan", now_sec() - start, visited ? visited : 1);
+
+    start = now_sec();
+    for (size_t i = 0; i < n; ++i) btree_delete(&tree, nums[i]);
+    REPORT("delete", now_sec() - start, n);
+
+    btree_dtor(&tree);
+    free(nums);
+    free(keys);
+}
+
+static void bench_radix(const size_t n)
+{
+    printf("tree vs radix on shared-prefix keys, %zu keys\n", n);
+
+    const size_t key_size = 64;
+    char* keys = make_keys(n, STREAM_RANDOM);
+    char* long_keys = (char*)calloc(n, key_size);
+    if (!keys || !long_keys) { free(keys); free(long_keys); return; }
+    for (size_t i = 0; i < n; ++i)
+        snprintf(long_keys + i * key_size, key_size, "tenant/eu-west/user/profile/%s", keys + i * KEY_BUF_SIZE);
+
+    CREATE_TREE(tree);
+    CREATE_RADIX(radix);
+
+    double start = now_sec();
+    for (size_t i = 0; i < n; ++i) tree_insert(&tree, long_keys + i * key_size);
+    REPORT("tree ins", now_sec() - start, n);
+
+    start = now_sec();
+    for (size_t i = 0; i < n; ++i) radix_insert(&radix, long_keys + i * key_size, i);
+    REPORT("radix ins", now_sec() - start, n);
+
+    node_t* found = NULL;
+    start = now_sec();
+    for (size_t i = 0; i < n; ++i) tree_find(&tree, long_keys + i * key_size, &found);
+    REPORT("tree find", now_sec() - start, n);
+
+    radix_value_t value = 0;
+    start = now_sec();
+    for (size_t i = 0; i < n; ++i) radix_find(&radix, long_keys + i * key_size, &value);
+    REPORT("radix find", now_sec() - start, n);
+
+    printf("  %-10s %8.1f B/key\n", "tree mem",  (double)tree.slab.bytes_reserved  / (double)(n ? n : 1));
+    printf("  %-10s %8.1f B/key\n", "radix mem", (double)radix.slab.bytes_reserved / (double)(n ? n : 1));
+
+    radix_dtor(&radix);
+    tree_dtor(&tree);
+    free(long_keys);
+    free(keys);
+}
+
+int main(const int argc, char* const argv[])
+{
+    const size_t n = (argc > 1) ? (size_t)strtoull(argv[1], NULL, 10) : DEFAULT_BENCH_SIZE;
+
+    init_logging("bench.log", WARN);
+
+    bench_tree_streams(n);
+    bench_tree_bulk(n);
+    bench_tree_frozen(n);
+    bench_tree_batch(n);
+    bench_list_batch(n);
+    bench_tree_linearize(n);
+    bench_tree_load(n);
+    bench_tree_parallel(n);
+    bench_tree_concurrent(n);
+    bench_tree_persistent(n);
+    bench_typed_tree(n);
+    bench_btree(n);
+    bench_radix(n);
+
+    close_log_file();
+    return 0;
+}
@@ -1 +1 @@
-gcc -fsanitize=address,leak,undefined -O2 -Wall -Wextra -Wno-unused-function -lm -D __DEBUG__ -I./ libs/logging/logging.c libs/io/io.c datastructures/list/list.c datastructures/list/dump/dump.c datastructures/tree/tree.c datastructures/tree/dump/dump.c main.c -o dist/main.out
+gcc -pthread -fsanitize=address,leak,undefined -O2 -Wall -Wextra -Wno-unused-function -lm -D __DEBUG__ -D __LIST_STATS__ -D __TREE_STATS__ -I./ libs/logging/logging.c libs/io/io.c libs/alloc/alloc.c libs/pool/pool.c datastructures/list/list.c datastructures/list/compact/compact.c datastructures/list/dump/dump.c datastructures/tree/tree.c datastructures/tree/slab/slab.c datastructures/tree/iter/iter.c datastructures/tree/parallel/parallel.c datastructures/tree/concurrent/concurrent.c datastructures/tree/persistent/persistent.c datastructures/tree/frozen/frozen.c datastructures/tree/serial/serial.c datastructures/tree/dump/dump.c datastructures/btree/btree.c datastructures/radix/radix.c main.c -o dist/main.out
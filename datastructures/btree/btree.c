@@ -0,0 +1,519 @@
+#include "btree.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+_Static_assert(sizeof(btree_leaf_t)  <= BTREE_NODE_BYTES, "btree leaf does not fit a node");
+_Static_assert(sizeof(btree_inner_t) <= BTREE_NODE_BYTES, "btree inner does not fit a node");
+
+#define AS_LEAF(node)  ((btree_leaf_t*)(node))
+#define AS_INNER(node) ((btree_inner_t*)(node))
+
+// Keys are sorted, so counting the smaller ones gives the lower bound
+static inline size_t count_less(const btree_key_t* keys, const size_t n, const btree_key_t key)
+{
+    size_t i = 0, count = 0;
+#if defined(__AVX2__)
+    const __m256i k = _mm256_set1_epi64x(key);
+    for (; i + 4 <= n; i += 4)
+    {
+        const __m256i block = _mm256_loadu_si256((const __m256i*)(keys + i));
+        const int     mask  = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(k, block)));
+        count += (size_t)__builtin_popcount((unsigned)mask);
+    }
+#endif
+    for (; i < n; ++i) count += (size_t)(keys[i] < key);
+    return count;
+}
+
+static inline size_t count_less_equal(const btree_key_t* keys, const size_t n, const btree_key_t key)
+{
+    return (key == INT64_MAX) ? n : count_less(keys, n, key + 1);
+}
+
+static btree_node_t* node_alloc(btree_t * const tree, const bool is_leaf)
+{
+    btree_node_t* node = (btree_node_t*)slab_record_alloc(&tree->slab, tree->allocator);
+    if (!CHECK(ERROR, node != NULL, "btree: node alloc failed"))
+        return NULL;
+
+    memset(node, 0, BTREE_NODE_BYTES);
+    node->is_leaf = is_leaf;
+    tree->nodes_amount += 1;
+    return node;
+}
+
+static void node_free(btree_t * const tree, btree_node_t * const node)
+{
+    slab_record_free(&tree->slab, node);
+    tree->nodes_amount -= 1;
+}
+
+err_t btree_ctor(btree_t * const tree, const allocator_t * const allocator)
+{
+    if (!CHECK(ERROR, tree != NULL, "btree_ctor: tree is NULL"))
+        return ERR_BAD_ARG;
+
+    *tree = (btree_t){ 0 };
+    tree->allocator = allocator;
+    slab_init_aligned(&tree->slab, BTREE_NODE_BYTES, BTREE_LINE);
+    return OK;
+}
+
+err_t btree_dtor(btree_t * const tree)
+{
+    if (!CHECK(ERROR, tree != NULL, "btree_dtor: tree is NULL"))
+        return ERR_BAD_ARG;
+
+    slab_clear(&tree->slab, tree->allocator);
+    tree->root         = NULL;
+    tree->first        = NULL;
+    tree->size         = 0;
+    tree->height       = 0;
+    tree->nodes_amount = 0;
+    return OK;
+}
+
+static const btree_leaf_t* find_leaf(const btree_t * const tree, const btree_key_t key)
+{
+    const btree_node_t* node = tree->root;
+    if (node == NULL) return NULL;
+
+    while (!node->is_leaf)
+    {
+        const btree_inner_t* inner = (const btree_inner_t*)node;
+        node = inner->children[count_less_equal(inner->keys, inner->hdr.count, key)];
+    }
+    return (const btree_leaf_t*)node;
+}
+
+err_t btree_find(const btree_t * const tree, const btree_key_t key, btree_value_t * const value)
+{
+    if (!CHECK(ERROR, tree != NULL, "btree_find: tree is NULL"))
+        return ERR_BAD_ARG;
+
+    const btree_leaf_t* leaf = find_leaf(tree, key);
+    if (leaf == NULL) return ERR_NOT_FOUND;
+
+    const size_t pos = count_less(leaf->keys, leaf->hdr.count, key);
+    if (pos == leaf->hdr.count || leaf->keys[pos] != key) return ERR_NOT_FOUND;
+
+    if (value) *value = leaf->values[pos];
+    return OK;
+}
+
+typedef struct
+{
+    btree_inner_t* node;
+    size_t         index;
+} path_step_t;
+
+static size_t descend(const btree_t * const tree, const btree_key_t key,
+                      path_step_t path[BTREE_MAX_HEIGHT], btree_leaf_t ** const leaf)
+{
+    size_t        depth = 0;
+    btree_node_t* node  = tree->root;
+
+    while (!node->is_leaf)
+    {
+        btree_inner_t* inner = AS_INNER(node);
+        const size_t   index = count_less_equal(inner->keys, inner->hdr.count, key);
+        path[depth++] = (path_step_t){ inner, index };
+        node = inner->children[index];
+    }
+
+    *leaf = AS_LEAF(node);
+    return depth;
+}
+
+// Nodes a leaf split takes: the new leaf, one per full inner node above it
+// and a new root when every level splits
+static size_t split_nodes(const path_step_t path[], size_t depth)
+{
+    size_t needed = 1;
+    for (; depth > 0 && path[depth - 1].node->hdr.count == BTREE_INNER_KEYS; --depth)
+        needed += 1;
+    return needed + (depth == 0);
+}
+
+// Put separator and right child at slot index of inner, splitting full nodes
+// with the preallocated spare ones
+static void inner_insert(btree_t * const tree, path_step_t path[], size_t depth,
+                         btree_key_t sep, btree_node_t* right, btree_node_t** spare)
+{
+    while (depth > 0)
+    {
+        btree_inner_t* inner = path[depth - 1].node;
+        const size_t   index = path[depth - 1].index;
+        const size_t   count = inner->hdr.count;
+
+        if (count < BTREE_INNER_KEYS)
+        {
+            memmove(&inner->keys[index + 1],     &inner->keys[index],
+                    (count - index) * sizeof(btree_key_t));
+            memmove(&inner->children[index + 2], &inner->children[index + 1],
+                    (count - index) * sizeof(btree_node_t*));
+            inner->keys[index]         = sep;
+            inner->children[index + 1] = right;
+            inner->hdr.count += 1;
+            return;
+        }
+
+        btree_key_t   keys    [BTREE_INNER_KEYS + 1];
+        btree_node_t* children[BTREE_INNER_KEYS + 2];
+
+        memcpy(keys, inner->keys, index * sizeof(btree_key_t));
+        keys[index] = sep;
+        memcpy(&keys[index + 1], &inner->keys[index], (count - index) * sizeof(btree_key_t));
+
+        memcpy(children, inner->children, (index + 1) * sizeof(btree_node_t*));
+        children[index + 1] = right;
+        memcpy(&children[index + 2], &inner->children[index + 1],
+               (count - index) * sizeof(btree_node_t*));
+
+        btree_inner_t* sibling = AS_INNER(*spare++);
+
+        const size_t total = count + 1;
+        const size_t left  = total / 2;
+        const size_t moved = total - left - 1;
+
+        memcpy(inner->keys,     keys,     left * sizeof(btree_key_t));
+        memcpy(inner->children, children, (left + 1) * sizeof(btree_node_t*));
+        inner->hdr.count = (uint32_t)left;
+
+        memcpy(sibling->keys,     &keys[left + 1],     moved * sizeof(btree_key_t));
+        memcpy(sibling->children, &children[left + 1], (moved + 1) * sizeof(btree_node_t*));
+        sibling->hdr.count = (uint32_t)moved;
+
+        sep   = keys[left];
+        right = &sibling->hdr;
+        depth -= 1;
+    }
+
+    btree_inner_t* root = AS_INNER(*spare);
+    root->keys[0]     = sep;
+    root->children[0] = tree->root;
+    root->children[1] = right;
+    root->hdr.count   = 1;
+    tree->root        = &root->hdr;
+    tree->height     += 1;
+}
+
+err_t btree_insert(btree_t * const tree, const btree_key_t key, const btree_value_t value)
+{
+    if (!CHECK(ERROR, tree != NULL, "btree_insert: tree is NULL"))
+        return ERR_BAD_ARG;
+
+    if (tree->root == NULL)
+    {
+        btree_leaf_t* leaf = AS_LEAF(node_alloc(tree, true));
+        if (leaf == NULL) return ERR_ALLOC;
+        tree->root   = &leaf->hdr;
+        tree->first  = leaf;
+        tree->height = 1;
+    }
+
+    path_step_t   path[BTREE_MAX_HEIGHT];
+    btree_leaf_t* leaf  = NULL;
+    const size_t  depth = descend(tree, key, path, &leaf);
+
+    const size_t count = leaf->hdr.count;
+    const size_t pos   = count_less(leaf->keys, count, key);
+    if (pos < count && leaf->keys[pos] == key)
+    {
+        leaf->values[pos] = value;
+        return OK;
+    }
+
+    if (count < BTREE_LEAF_KEYS)
+    {
+        memmove(&leaf->keys[pos + 1],   &leaf->keys[pos],   (count - pos) * sizeof(btree_key_t));
+        memmove(&leaf->values[pos + 1], &leaf->values[pos], (count - pos) * sizeof(btree_value_t));
+        leaf->keys[pos]   = key;
+        leaf->values[pos] = value;
+        leaf->hdr.count  += 1;
+        tree->size       += 1;
+        return OK;
+    }
+
+    // Every node of the split chain is taken before anything changes
+    btree_node_t* spare[BTREE_MAX_HEIGHT + 1];
+    const size_t  needed = split_nodes(path, depth);
+    for (size_t i = 0; i < needed; ++i)
+    {
+        spare[i] = node_alloc(tree, i == 0);
+        if (spare[i] == NULL)
+        {
+            while (i-- > 0) node_free(tree, spare[i]);
+            return ERR_ALLOC;
+        }
+    }
+
+    btree_leaf_t* sibling = AS_LEAF(spare[0]);
+
+    // Split the full leaf plus the new key in halves, the new one goes right
+    const size_t total = count + 1;
+    const size_t left  = total / 2;
+    btree_key_t   keys  [BTREE_LEAF_KEYS + 1];
+    btree_value_t values[BTREE_LEAF_KEYS + 1];
+
+    memcpy(keys,   leaf->keys,   pos * sizeof(btree_key_t));
+    memcpy(values, leaf->values, pos * sizeof(btree_value_t));
+    keys[pos]   = key;
+    values[pos] = value;
+    memcpy(&keys[pos + 1],   &leaf->keys[pos],   (count - pos) * sizeof(btree_key_t));
+    memcpy(&values[pos + 1], &leaf->values[pos], (count - pos) * sizeof(btree_value_t));
+
+    memcpy(leaf->keys,   keys,   left * sizeof(btree_key_t));
+    memcpy(leaf->values, values, left * sizeof(btree_value_t));
+    leaf->hdr.count = (uint32_t)left;
+
+    memcpy(sibling->keys,   &keys[left],   (total - left) * sizeof(btree_key_t));
+    memcpy(sibling->values, &values[left], (total - left) * sizeof(btree_value_t));
+    sibling->hdr.count = (uint32_t)(total - left);
+
+    sibling->next = leaf->next;
+    sibling->prev = leaf;
+    if (leaf->next) leaf->next->prev = sibling;
+    leaf->next = sibling;
+
+    tree->size += 1;
+    inner_insert(tree, path, depth, sibling->keys[0], &sibling->hdr, spare + 1);
+    return OK;
+}
+
+static void inner_remove(btree_inner_t * const inner, const size_t key_index)
+{
+    const size_t count = inner->hdr.count;
+    memmove(&inner->keys[key_index], &inner->keys[key_index + 1],
+            (count - key_index - 1) * sizeof(btree_key_t));
+    memmove(&inner->children[key_index + 1], &inner->children[key_index + 2],
+            (count - key_index - 1) * sizeof(btree_node_t*));
+    inner->hdr.count -= 1;
+}
+
+// Refill leaf children[index] of parent from a sibling, true if no merge was needed
+static bool leaf_fix(btree_t * const tree, btree_inner_t * const parent, const size_t index)
+{
+    btree_leaf_t* node  = AS_LEAF(parent->children[index]);
+    btree_leaf_t* left  = index > 0                 ? AS_LEAF(parent->children[index - 1]) : NULL;
+    btree_leaf_t* right = index < parent->hdr.count ? AS_LEAF(parent->children[index + 1]) : NULL;
+
+    if (left && left->hdr.count > BTREE_LEAF_MIN)
+    {
+        memmove(&node->keys[1],   node->keys,   node->hdr.count * sizeof(btree_key_t));
+        memmove(&node->values[1], node->values, node->hdr.count * sizeof(btree_value_t));
+        left->hdr.count -= 1;
+        node->keys[0]    = left->keys[left->hdr.count];
+        node->values[0]  = left->values[left->hdr.count];
+        node->hdr.count += 1;
+        parent->keys[index - 1] = node->keys[0];
+        return true;
+    }
+
+    if (right && right->hdr.count > BTREE_LEAF_MIN)
+    {
+        node->keys[node->hdr.count]   = right->keys[0];
+        node->values[node->hdr.count] = right->values[0];
+        node->hdr.count  += 1;
+        right->hdr.count -= 1;
+        memmove(right->keys,   &right->keys[1],   right->hdr.count * sizeof(btree_key_t));
+        memmove(right->values, &right->values[1], right->hdr.count * sizeof(btree_value_t));
+        parent->keys[index] = right->keys[0];
+        return true;
+    }
+
+    // Merge the right one of the pair into the left one
+    btree_leaf_t* dst = left ? left : node;
+    btree_leaf_t* src = left ? node : right;
+    const size_t  sep = left ? index - 1 : index;
+
+    memcpy(&dst->keys[dst->hdr.count],   src->keys,   src->hdr.count * sizeof(btree_key_t));
+    memcpy(&dst->values[dst->hdr.count], src->values, src->hdr.count * sizeof(btree_value_t));
+    dst->hdr.count += src->hdr.count;
+
+    dst->next = src->next;
+    if (src->next) src->next->prev = dst;
+
+    inner_remove(parent, sep);
+    node_free(tree, &src->hdr);
+    return false;
+}
+
+static bool inner_fix(btree_t * const tree, btree_inner_t * const parent, const size_t index)
+{
+    btree_inner_t* node  = AS_INNER(parent->children[index]);
+    btree_inner_t* left  = index > 0                 ? AS_INNER(parent->children[index - 1]) : NULL;
+    btree_inner_t* right = index < parent->hdr.count ? AS_INNER(parent->children[index + 1]) : NULL;
+
+    if (left && left->hdr.count > BTREE_INNER_MIN)
+    {
+        memmove(&node->keys[1],     node->keys,     node->hdr.count * sizeof(btree_key_t));
+        memmove(&node->children[1], node->children, (node->hdr.count + 1) * sizeof(btree_node_t*));
+        node->keys[0]     = parent->keys[index - 1];
+        node->children[0] = left->children[left->hdr.count];
+        node->hdr.count  += 1;
+        parent->keys[index - 1] = left->keys[left->hdr.count - 1];
+        left->hdr.count  -= 1;
+        return true;
+    }
+
+    if (right && right->hdr.count > BTREE_INNER_MIN)
+    {
+        node->keys[node->hdr.count]         = parent->keys[index];
+        node->children[node->hdr.count + 1] = right->children[0];
+        node->hdr.count    += 1;
+        parent->keys[index] = right->keys[0];
+        memmove(right->keys,     &right->keys[1],     (right->hdr.count - 1) * sizeof(btree_key_t));
+        memmove(right->children, &right->children[1], right->hdr.count * sizeof(btree_node_t*));
+        right->hdr.count   -= 1;
+        return true;
+    }
+
+    btree_inner_t* dst = left ? left : node;
+    btree_inner_t* src = left ? node : right;
+    const size_t   sep = left ? index - 1 : index;
+
+    dst->keys[dst->hdr.count] = parent->keys[sep];
+    memcpy(&dst->keys[dst->hdr.count + 1],     src->keys,     src->hdr.count * sizeof(btree_key_t));
+    memcpy(&dst->children[dst->hdr.count + 1], src->children, (src->hdr.count + 1) * sizeof(btree_node_t*));
+    dst->hdr.count += src->hdr.count + 1;
+
+    inner_remove(parent, sep);
+    node_free(tree, &src->hdr);
+    return false;
+}
+
+err_t btree_delete(btree_t * const tree, const btree_key_t key)
+{
+    if (!CHECK(ERROR, tree != NULL, "btree_delete: tree is NULL"))
+        return ERR_BAD_ARG;
+
+    if (tree->root == NULL) return ERR_NOT_FOUND;
+
+    path_step_t   path[BTREE_MAX_HEIGHT];
+    btree_leaf_t* leaf  = NULL;
+    size_t        depth = descend(tree, key, path, &leaf);
+
+    const size_t count = leaf->hdr.count;
+    const size_t pos   = count_less(leaf->keys, count, key);
+    if (pos == count || leaf->keys[pos] != key) return ERR_NOT_FOUND;
+
+    memmove(&leaf->keys[pos],   &leaf->keys[pos + 1],   (count - pos - 1) * sizeof(btree_key_t));
+    memmove(&leaf->values[pos], &leaf->values[pos + 1], (count - pos - 1) * sizeof(btree_value_t));
+    leaf->hdr.count -= 1;
+    tree->size      -= 1;
+
+    if (depth == 0 || leaf->hdr.count >= BTREE_LEAF_MIN) return OK;
+
+    // Stale separators still route correctly, only underflow needs work
+    bool settled = leaf_fix(tree, path[depth - 1].node, path[depth - 1].index);
+    while (!settled && --depth > 0)
+    {
+        if (path[depth].node->hdr.count >= BTREE_INNER_MIN) return OK;
+        settled = inner_fix(tree, path[depth - 1].node, path[depth - 1].index);
+    }
+
+    btree_inner_t* root = AS_INNER(tree->root);
+    if (!root->hdr.is_leaf && root->hdr.count == 0)
+    {
+        tree->root    = root->children[0];
+        tree->height -= 1;
+        node_free(tree, &root->hdr);
+    }
+    return OK;
+}
+
+void btree_first(const btree_t * const tree, btree_cursor_t * const cursor)
+{
+    cursor->leaf  = (tree->first && tree->first->hdr.count) ? tree->first : NULL;
+    cursor->index = 0;
+}
+
+void btree_seek(const btree_t * const tree, const btree_key_t key, btree_cursor_t * const cursor)
+{
+    const btree_leaf_t* leaf = find_leaf(tree, key);
+    size_t pos = leaf ? count_less(leaf->keys, leaf->hdr.count, key) : 0;
+
+    if (leaf && pos == leaf->hdr.count)
+    {
+        leaf = leaf->next;
+        pos  = 0;
+    }
+    cursor->leaf  = (leaf && leaf->hdr.count) ? leaf : NULL;
+    cursor->index = pos;
+}
+
+bool btree_cursor_next(btree_cursor_t * const cursor)
+{
+    if (cursor->leaf == NULL) return false;
+
+    if (++cursor->index >= cursor->leaf->hdr.count)
+    {
+        cursor->leaf  = cursor->leaf->next;
+        cursor->index = 0;
+    }
+    return cursor->leaf != NULL;
+}
+
+err_t btree_verify(const btree_t * const tree)
+{
+    if (!CHECK(ERROR, tree != NULL, "btree_verify: tree is NULL"))
+        return ERR_BAD_ARG;
+
+    if (tree->root == NULL)
+    {
+        if (!CHECK(ERROR, tree->size == 0, "btree_verify: size=%zu but root is NULL", tree->size))
+            return ERR_CORRUPT;
+        return OK;
+    }
+
+    // Level by level: every level must be sorted and bounded by the parent separators
+    const btree_node_t* level = tree->root;
+    for (size_t h = 1; h < tree->height; ++h)
+    {
+        if (!CHECK(ERROR, !level->is_leaf, "btree_verify: leaf above depth %zu", tree->height))
+            return ERR_CORRUPT;
+        level = AS_INNER(level)->children[0];
+    }
+    if (!CHECK(ERROR, level->is_leaf, "btree_verify: height %zu too small", tree->height))
+        return ERR_CORRUPT;
+    if (!CHECK(ERROR, (const btree_leaf_t*)level == tree->first, "btree_verify: first leaf mismatch"))
+        return ERR_CORRUPT;
+
+    size_t seen = 0;
+    bool   have_prev = false;
+    btree_key_t prev = 0;
+    const btree_leaf_t* back = NULL;
+    for (const btree_leaf_t* leaf = tree->first; leaf != NULL; leaf = leaf->next)
+    {
+        if (!CHECK(ERROR, leaf->prev == back, "btree_verify: broken prev link at leaf %p", (void*)leaf))
+            return ERR_CORRUPT;
+        if (!CHECK(ERROR, leaf->hdr.count > 0 || tree->height == 1,
+                   "btree_verify: empty leaf %p", (void*)leaf))
+            return ERR_CORRUPT;
+
+        for (size_t i = 0; i < leaf->hdr.count; ++i)
+        {
+            if (!CHECK(ERROR, !have_prev || prev < leaf->keys[i],
+                       "btree_verify: keys out of order at leaf %p", (void*)leaf))
+                return ERR_CORRUPT;
+            prev = leaf->keys[i];
+            have_prev = true;
+
+            const btree_leaf_t* home = find_leaf(tree, prev);
+            if (!CHECK(ERROR, home == leaf, "btree_verify: key %lld routes to a wrong leaf",
+                       (long long)prev))
+                return ERR_CORRUPT;
+        }
+        seen += leaf->hdr.count;
+        back  = leaf;
+    }
+
+    if (!CHECK(ERROR, seen == tree->size, "btree_verify: size=%zu but leaves hold %zu",
+               tree->size, seen))
+        return ERR_CORRUPT;
+
+    return OK;
+}
@@ -0,0 +1,113 @@
+#ifndef BTREE_H
+#define BTREE_H
+
+#include "../../libs/logging/logging.h"
+#include "../../libs/alloc/alloc.h"
+#include "../../libs/types.h"
+
+#include "../tree/slab/slab.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+/*
+    Every node is BTREE_NODE_BYTES long and aligned to a cache line, keys of
+    a node are contiguous so an in-node search streams whole lines
+*/
+#define BTREE_LINE        64
+#define BTREE_NODE_BYTES  512
+#define BTREE_LEAF_KEYS   30
+#define BTREE_INNER_KEYS  31
+#define BTREE_LEAF_MIN    (BTREE_LEAF_KEYS  / 2)
+#define BTREE_INNER_MIN   (BTREE_INNER_KEYS / 2)
+
+// Fanout of at least 16 per level, 32 levels cover any address space
+#define BTREE_MAX_HEIGHT  32
+
+typedef int64_t  btree_key_t;
+typedef uint64_t btree_value_t;
+
+typedef struct
+{
+    uint32_t count;
+    uint32_t is_leaf;
+} btree_node_t;
+
+typedef struct btree_leaf_t
+{
+    btree_node_t         hdr;
+    struct btree_leaf_t* next;
+    struct btree_leaf_t* prev;
+    btree_key_t          keys  [BTREE_LEAF_KEYS];
+    btree_value_t        values[BTREE_LEAF_KEYS];
+} btree_leaf_t;
+
+/*
+    keys[i] is the smallest key reachable through children[i + 1]
+*/
+typedef struct
+{
+    btree_node_t  hdr;
+    btree_key_t   keys    [BTREE_INNER_KEYS];
+    btree_node_t* children[BTREE_INNER_KEYS + 1];
+} btree_inner_t;
+
+typedef struct
+{
+    btree_node_t* root;
+    btree_leaf_t* first;
+
+    size_t        size;
+    size_t        height;
+    size_t        nodes_amount;
+
+    const allocator_t* allocator;
+    tslab_t            slab;
+} btree_t;
+
+/*
+    Position in the leaf chain, leaf == NULL past the last key
+*/
+typedef struct
+{
+    const btree_leaf_t* leaf;
+    size_t              index;
+} btree_cursor_t;
+
+#define CREATE_BTREE(tree_name)   \
+    btree_t tree_name = { 0 };    \
+    btree_ctor(&(tree_name), NULL)
+
+err_t btree_ctor  (btree_t * const tree, const allocator_t * const allocator);
+err_t btree_dtor  (btree_t * const tree);
+err_t btree_verify(const btree_t * const tree);
+
+/*
+    Insert key or overwrite the value of an existing one
+*/
+err_t btree_insert(btree_t * const tree, const btree_key_t key, const btree_value_t value);
+err_t btree_find  (const btree_t * const tree, const btree_key_t key, btree_value_t * const value);
+err_t btree_delete(btree_t * const tree, const btree_key_t key);
+
+void  btree_first (const btree_t * const tree, btree_cursor_t * const cursor);
+void  btree_seek  (const btree_t * const tree, const btree_key_t key, btree_cursor_t * const cursor);
+bool  btree_cursor_next(btree_cursor_t * const cursor);
+
+static inline bool btree_cursor_valid(const btree_cursor_t * const cursor)
+{
+    return cursor->leaf != NULL;
+}
+
+static inline btree_key_t btree_cursor_key(const btree_cursor_t * const cursor)
+{
+    return cursor->leaf->keys[cursor->index];
+}
+
+static inline btree_value_t btree_cursor_value(const btree_cursor_t * const cursor)
+{
+    return cursor->leaf->values[cursor->index];
+}
+
+#endif
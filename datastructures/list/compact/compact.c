@@ -0,0 +1,368 @@
+#include "compact.h"
+
+#define NO_RUN ((size_t)-1)
+
+static inline size_t run_last(const list_run_t* r) { return r->start + r->length - 1; }
+
+static size_t find_run(const list_compact_t* c, size_t i)
+{
+    size_t lo = 0, hi = c->runs_amount;
+    while (lo < hi)
+    {
+        const size_t mid = lo + (hi - lo) / 2;
+        if (c->runs[mid].start <= i) lo = mid + 1;
+        else                         hi = mid;
+    }
+    if (lo == 0) return NO_RUN;
+    return (i <= run_last(&c->runs[lo - 1])) ? lo - 1 : NO_RUN;
+}
+
+static size_t lower_run(const list_compact_t* c, size_t i)
+{
+    size_t lo = 0, hi = c->runs_amount;
+    while (lo < hi)
+    {
+        const size_t mid = lo + (hi - lo) / 2;
+        if (c->runs[mid].start < i) lo = mid + 1;
+        else                        hi = mid;
+    }
+    return lo;
+}
+
+size_t compact_next(const list_t * const list, const size_t index)
+{
+    const list_compact_t* c = list->compact;
+    if (index == 0) return c->head;
+
+    const size_t k = find_run(c, index);
+    if (k == NO_RUN) return 0;
+    return (index < run_last(&c->runs[k])) ? index + 1 : c->runs[k].next;
+}
+
+size_t compact_prev(const list_t * const list, const size_t index)
+{
+    const list_compact_t* c = list->compact;
+    if (index == 0) return c->tail;
+
+    const size_t k = find_run(c, index);
+    if (k == NO_RUN) return LIST_FREE;
+    return (index > c->runs[k].start) ? index - 1 : c->runs[k].prev;
+}
+
+int compact_is_free(const list_t * const list, const size_t index)
+{
+    return index != 0 && find_run(list->compact, index) == NO_RUN;
+}
+
+static err_t reserve_runs(list_t* list, size_t extra)
+{
+    list_compact_t* c = list->compact;
+    const size_t need = c->runs_amount + extra;
+    if (need <= c->runs_capacity) return OK;
+
+    size_t new_cap = c->runs_capacity ? c->runs_capacity * 2 : 4;
+    if (new_cap < need) new_cap = need;
+
+    list_run_t* runs = (list_run_t*)mem_realloc(list->allocator, c->runs,
+                                                c->runs_capacity * sizeof(*runs),
+                                                new_cap * sizeof(*runs));
+    if (!CHECK(ERROR, runs != NULL, "runs alloc failed")) return ERR_ALLOC;
+
+    c->runs          = runs;
+    c->runs_capacity = new_cap;
+    return OK;
+}
+
+static void insert_run(list_compact_t* c, size_t pos, list_run_t run)
+{
+    memmove(c->runs + pos + 1, c->runs + pos, (c->runs_amount - pos) * sizeof(*c->runs));
+    c->runs[pos] = run;
+    c->runs_amount++;
+}
+
+static void remove_run(list_compact_t* c, size_t pos)
+{
+    memmove(c->runs + pos, c->runs + pos + 1, (c->runs_amount - pos - 1) * sizeof(*c->runs));
+    c->runs_amount--;
+}
+
+// Cut run k after slot i (i < last), both halves keep the implicit links as explicit ones
+static void split_after(list_compact_t* c, size_t k, size_t i)
+{
+    list_run_t* r = &c->runs[k];
+    const list_run_t tail_part = {
+        .start  = i + 1,
+        .length = run_last(r) - i,
+        .prev   = i,
+        .next   = r->next,
+    };
+    r->length = i - r->start + 1;
+    r->next   = i + 1;
+    insert_run(c, k + 1, tail_part);
+}
+
+static void set_next(list_compact_t* c, size_t i, size_t v)
+{
+    size_t k = find_run(c, i);
+    if (i < run_last(&c->runs[k]))
+    {
+        if (v == i + 1) return;
+        split_after(c, k, i);
+    }
+    c->runs[k].next = v;
+}
+
+static void set_prev(list_compact_t* c, size_t i, size_t v)
+{
+    size_t k = find_run(c, i);
+    if (i > c->runs[k].start)
+    {
+        if (v == i - 1) return;
+        split_after(c, k, i - 1);
+        k++;
+    }
+    c->runs[k].prev = v;
+}
+
+static void try_merge(list_compact_t* c, size_t k)
+{
+    if (k + 1 >= c->runs_amount) return;
+
+    list_run_t*       a = &c->runs[k];
+    const list_run_t* b = &c->runs[k + 1];
+    const size_t      a_last = run_last(a);
+
+    if (a_last + 1 == b->start && a->next == b->start && b->prev == a_last)
+    {
+        a->length += b->length;
+        a->next    = b->next;
+        remove_run(c, k + 1);
+    }
+}
+
+static void merge_around(list_compact_t* c, size_t i)
+{
+    const size_t k = find_run(c, i);
+    if (k == NO_RUN) return;
+    try_merge(c, k);
+    if (k > 0) try_merge(c, k - 1);
+}
+
+// Prefer slots extending the neighbours' runs, otherwise the lowest gap.
+// A new head is only logically after the tail through the wrap, so it
+// grows the head's run downwards and otherwise starts from the top gap
+static size_t pick_slot(const list_t* list, size_t left, size_t right, bool new_head)
+{
+    const list_compact_t* c   = list->compact;
+    const size_t          cap = list->list_capacity;
+
+    if (!new_head && left && left + 1 < cap && compact_is_free(list, left + 1)) return left + 1;
+    if (right > 1 && compact_is_free(list, right - 1))                          return right - 1;
+
+    if (new_head)
+    {
+        size_t highest = cap - 1;
+        for (size_t k = c->runs_amount; k > 0; --k)
+        {
+            if (run_last(&c->runs[k - 1]) < highest) return highest;
+            highest = c->runs[k - 1].start - 1;
+        }
+        return highest;
+    }
+
+    size_t expected = 1;
+    for (size_t k = 0; k < c->runs_amount; ++k)
+    {
+        if (c->runs[k].start > expected) return expected;
+        expected = run_last(&c->runs[k]) + 1;
+    }
+    return (expected < cap) ? expected : 0;
+}
+
+err_t compact_link_after(list_t * const list, const size_t index, size_t * const slot)
+{
+    list_compact_t* c = list->compact;
+    if (reserve_runs(list, 3) != OK) return ERR_ALLOC;
+
+    if (list->list_size == 0)
+    {
+        const size_t n = pick_slot(list, 0, 0, false);
+        if (!CHECK(ERROR, n != 0, "no free slot")) return ERR_CORRUPT;
+
+        insert_run(c, 0, (list_run_t){ .start = n, .length = 1, .prev = n, .next = n });
+        c->head = c->tail = n;
+        list->list_size = 1;
+        *slot = n;
+        return OK;
+    }
+
+    const size_t left  = (index == 0) ? c->tail : index;
+    const size_t right = (index == 0) ? c->head : compact_next(list, index);
+
+    const size_t n = pick_slot(list, left, right, index == 0);
+    if (!CHECK(ERROR, n != 0, "no free slot")) return ERR_CORRUPT;
+
+    set_next(c, left,  n);
+    set_prev(c, right, n);
+    insert_run(c, lower_run(c, n), (list_run_t){ .start = n, .length = 1, .prev = left, .next = right });
+
+    merge_around(c, n);
+    merge_around(c, left);
+    merge_around(c, right);
+
+    if (index == 0)       c->head = n;
+    if (index == c->tail) c->tail = n;
+
+    list->list_size += 1;
+    *slot = n;
+    return OK;
+}
+
+err_t compact_unlink(list_t * const list, const size_t index)
+{
+    list_compact_t* c = list->compact;
+    if (reserve_runs(list, 3) != OK) return ERR_ALLOC;
+
+    const size_t prv = compact_prev(list, index);
+    const size_t nxt = compact_next(list, index);
+
+    size_t k = find_run(c, index);
+    if (index > c->runs[k].start)
+    {
+        split_after(c, k, index - 1);
+        k++;
+    }
+    if (index < run_last(&c->runs[k])) split_after(c, k, index);
+    remove_run(c, k);
+
+    if (list->list_size == 1)
+    {
+        c->head = c->tail = 0;
+    } else {
+        set_next(c, prv, nxt);
+        set_prev(c, nxt, prv);
+
+        if (index == c->head) c->head = nxt;
+        if (index == c->tail) c->tail = prv;
+
+        merge_around(c, prv);
+        merge_around(c, nxt);
+    }
+
+    list->list_size -= 1;
+    return OK;
+}
+
+size_t compact_materialize(const list_t * const list, size_t * const next, size_t * const prev)
+{
+    const list_compact_t* c   = list->compact;
+    const size_t          cap = list->list_capacity;
+
+    for (size_t i = 1; i < cap; ++i)
+        prev[i] = LIST_FREE;
+
+    for (size_t k = 0; k < c->runs_amount; ++k)
+    {
+        const list_run_t* r    = &c->runs[k];
+        const size_t      last = run_last(r);
+        for (size_t j = r->start; j <= last; ++j)
+        {
+            next[j] = (j < last)      ? j + 1 : r->next;
+            prev[j] = (j > r->start)  ? j - 1 : r->prev;
+        }
+    }
+
+    size_t free_index = 0;
+    for (size_t i = cap - 1; i > 0; --i)
+    {
+        if (prev[i] != LIST_FREE) continue;
+        next[i]    = free_index;
+        free_index = i;
+    }
+
+    next[0] = c->head;
+    prev[0] = c->tail;
+    return free_index;
+}
+
+err_t compact_verify(const list_t * const list)
+{
+    const list_compact_t* c = list->compact;
+
+    size_t covered = 0;
+    for (size_t k = 0; k < c->runs_amount; ++k)
+    {
+        const list_run_t* r = &c->runs[k];
+        if (!CHECK(ERROR, r->start > 0 && r->length > 0 && run_last(r) < list->list_capacity,
+                   "verify: run %zu out of range", k)) return ERR_CORRUPT;
+        if (!CHECK(ERROR, k == 0 || r->start > run_last(&c->runs[k - 1]),
+                   "verify: run %zu overlaps or unsorted", k)) return ERR_CORRUPT;
+        covered += r->length;
+    }
+
+    if (!CHECK(ERROR, covered == list->list_size, "verify: runs cover %zu slots, size %zu",
+               covered, list->list_size)) return ERR_CORRUPT;
+    if (!CHECK(ERROR, (list->list_size == 0) == (c->head == 0 && c->tail == 0),
+               "verify: head/tail don't match size")) return ERR_CORRUPT;
+
+    return OK;
+}
+
+err_t compact_from_links(list_t * const list)
+{
+    const allocator_t* a   = list->allocator;
+    const size_t       cap = list->list_capacity;
+
+    #define USED(i) ((i) < cap && list->prev[(i)] != LIST_FREE)
+    #define JOINED(i) (list->next[(i)] == (i) + 1 && USED((i) + 1) && list->prev[(i) + 1] == (i))
+
+    size_t amount = 0;
+    for (size_t i = 1; i < cap; ++i)
+        if (USED(i) && !(i > 1 && USED(i - 1) && JOINED(i - 1))) amount++;
+
+    list_compact_t* c = (list_compact_t*)mem_calloc(a, 1, sizeof(*c));
+    if (!CHECK(ERROR, c != NULL, "compact alloc failed")) return ERR_ALLOC;
+
+    c->runs_capacity = amount ? amount : 1;
+    c->runs          = (list_run_t*)mem_alloc(a, c->runs_capacity * sizeof(*c->runs));
+    if (!CHECK(ERROR, c->runs != NULL, "runs alloc failed"))
+    {
+        mem_free(a, c, sizeof(*c));
+        return ERR_ALLOC;
+    }
+
+    for (size_t i = 1; i < cap; )
+    {
+        if (!USED(i)) { ++i; continue; }
+
+        list_run_t run = { .start = i, .length = 1, .prev = list->prev[i] };
+        while (JOINED(i)) { ++i; run.length++; }
+        run.next = list->next[i];
+        c->runs[c->runs_amount++] = run;
+        ++i;
+    }
+
+    #undef JOINED
+    #undef USED
+
+    c->head = list->next[0];
+    c->tail = list->prev[0];
+
+    mem_free(a, list->next, cap * sizeof(*list->next));
+    mem_free(a, list->prev, cap * sizeof(*list->prev));
+    list->next       = NULL;
+    list->prev       = NULL;
+    list->free_index = 0;
+    list->compact    = c;
+    return OK;
+}
+
+void compact_free(list_t * const list)
+{
+    list_compact_t* c = list->compact;
+    if (!c) return;
+
+    mem_free(list->allocator, c->runs, c->runs_capacity * sizeof(*c->runs));
+    mem_free(list->allocator, c, sizeof(*c));
+    list->compact = NULL;
+}
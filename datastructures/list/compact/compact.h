@@ -0,0 +1,71 @@
+#ifndef LCOMPACT_H
+#define LCOMPACT_H
+
+#include "../list.h"
+#include "../../../libs/logging/logging.h"
+#include "../../../libs/alloc/alloc.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+    Physical extent [start, start + length) where next[i] == i + 1 and
+    prev[i + 1] == i. Only the links leaving the extent are stored
+*/
+typedef struct
+{
+    size_t start;
+    size_t length;
+    size_t prev;
+    size_t next;
+} list_run_t;
+
+/*
+    Run-length link table replacing next/prev in compact mode. Runs are
+    sorted by start and cover exactly the used slots, slot 0 (sentinel)
+    is kept apart as head/tail
+*/
+struct list_compact_t
+{
+    list_run_t* runs;
+    size_t      runs_amount;
+    size_t      runs_capacity;
+
+    size_t      head;
+    size_t      tail;
+};
+
+// Compact mode gives up and expands once it holds more than this many runs
+#define LIST_COMPACT_MAX_RUNS(cap) ((cap) / 4 + 1)
+
+size_t compact_next   (const list_t * const list, const size_t index);
+size_t compact_prev   (const list_t * const list, const size_t index);
+int    compact_is_free(const list_t * const list, const size_t index);
+
+/*
+    Link a free slot after index (0 - new head) and return it in slot.
+    Caller guarantees that a free slot exists and fills data
+*/
+err_t  compact_link_after(list_t * const list, const size_t index, size_t * const slot);
+
+/*
+    Unlink used slot index, caller clears its data
+*/
+err_t  compact_unlink    (list_t * const list, const size_t index);
+
+/*
+    Expand runs into full next/prev arrays of list_capacity slots,
+    free slots are chained in ascending order. Returns new free_index
+*/
+size_t compact_materialize(const list_t * const list, size_t * const next, size_t * const prev);
+
+err_t  compact_verify     (const list_t * const list);
+
+/*
+    Build runs from the current links and drop next/prev arrays
+*/
+err_t  compact_from_links (list_t * const list);
+void   compact_free       (list_t * const list);
+
+#endif
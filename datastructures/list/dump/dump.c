@@ -41,16 +41,42 @@ static int is_linearized(const list_t* l, size_t cap)
     }
 }
 
+static void free_scratch(const list_t* l, size_t cap, bool* on_main, bool* on_free, long* virtpos, bool* paired_from)
+{
+    mem_free(l->allocator, on_main,     cap * sizeof(bool));
+    mem_free(l->allocator, on_free,     cap * sizeof(bool));
+    mem_free(l->allocator, virtpos,     cap * sizeof(long));
+    mem_free(l->allocator, paired_from, cap * sizeof(bool));
+}
+
 void list_dump(const list_t *list, const char *title, const char *html_file)
 {
     if (!list || !html_file) return;
 
+    if (list->compact)
+    {
+        const size_t cap = list->list_capacity;
+
+        list_t view  = *list;
+        view.compact = NULL;
+        view.next    = (size_t*)mem_alloc(list->allocator, cap * sizeof(size_t));
+        view.prev    = (size_t*)mem_alloc(list->allocator, cap * sizeof(size_t));
+        if (view.next && view.prev)
+        {
+            view.free_index = compact_materialize(list, view.next, view.prev);
+            list_dump(&view, title, html_file);
+        }
+        mem_free(list->allocator, view.next, cap * sizeof(size_t));
+        mem_free(list->allocator, view.prev, cap * sizeof(size_t));
+        return;
+    }
+
     const size_t capacity = list->list_capacity;
 
-    bool *on_main = (bool*)calloc(capacity, sizeof(bool));
-    bool *on_free = (bool*)calloc(capacity, sizeof(bool));
-    long *virtpos = (long*)calloc(capacity, sizeof(long));
-    if (!on_main || !on_free || !virtpos) { free(on_main); free(on_free); free(virtpos); return; }
+    bool *on_main = (bool*)mem_calloc(list->allocator, capacity, sizeof(bool));
+    bool *on_free = (bool*)mem_calloc(list->allocator, capacity, sizeof(bool));
+    long *virtpos = (long*)mem_calloc(list->allocator, capacity, sizeof(long));
+    if (!on_main || !on_free || !virtpos) { free_scratch(list, capacity, on_main, on_free, virtpos, NULL); return; }
 
     mark_free_chain(list, capacity, on_free);
 
@@ -77,7 +103,7 @@ void list_dump(const list_t *list, const char *title, const char *html_file)
     snprintf(svg_path, sizeof(svg_path), "temp/l%s", svg_name);
 
     FILE *dot = fopen(dot_path, "w");
-    if (!dot) { free(on_main); free(on_free); free(virtpos); return; }
+    if (!dot) { free_scratch(list, capacity, on_main, on_free, virtpos, NULL); return; }
 
     const char *EDGE_NEXT = "#00E676";
     const char *EDGE_PREV = "#2962FF";
@@ -167,8 +193,8 @@ void list_dump(const list_t *list, const char *title, const char *html_file)
     if (in_bounds(tail, capacity)) fprintf(dot, "tailN -> label%zu [color=\"%s\", penwidth=2.2];\n", tail, EDGE_PREV);
     if (freei && in_bounds(freei, capacity)) fprintf(dot, "freeN -> label%zu [color=\"%s\", penwidth=2.2, style=dashed];\n", freei, EDGE_FREE);
 
-    bool *paired_from = (bool*)calloc(capacity, sizeof(bool));
-    if (!paired_from) { free(on_main); free(on_free); free(virtpos); fclose(dot); return; }
+    bool *paired_from = (bool*)mem_calloc(list->allocator, capacity, sizeof(bool));
+    if (!paired_from) { free_scratch(list, capacity, on_main, on_free, virtpos, NULL); fclose(dot); return; }
 
     
     for (size_t i = 0; i < capacity; ++i)
@@ -249,7 +275,7 @@ void list_dump(const list_t *list, const char *title, const char *html_file)
     system(cmd);
 
     FILE *html = fopen(html_file, "a");
-    if (!html) { free(on_main); free(on_free); free(virtpos); free(paired_from); return; }
+    if (!html) { free_scratch(list, capacity, on_main, on_free, virtpos, paired_from); return; }
 
     const int linear = is_linearized(list, capacity);
 
@@ -259,14 +285,16 @@ void list_dump(const list_t *list, const char *title, const char *html_file)
     fprintf(html, "<h3>Size: %zu, capacity: %zu</h3>\n", list->list_size, list->list_capacity);
     fprintf(html, "<h3>Head: %zu, Tail: %zu, Free: %zu</h3>\n", list->next[0], list->prev[0], list->free_index);
     fprintf(html, "<h3>Linearized: %d, needLinear: 1</h3>\n", linear);
+
+    list_stats_t stats = { 0 };
+    if (list_stats(list, &stats) == OK)
+        fprintf(html, "<h3>Fragmentation: %.3f, free chain: %zu, grows: %zu</h3>\n",
+                stats.fragmentation, stats.free_chain_length, stats.counters.grows);
     fprintf(html, "<h3>List addr: 0x%p</h3>\n", (void*)list);
     fprintf(html, "<img src=\"temp/l%s\" />\n", svg_name);
     fprintf(html, "</hr>\n");
     fclose(html);
 
-    free(on_main);
-    free(on_free);
-    free(virtpos);
-    free(paired_from);
+    free_scratch(list, capacity, on_main, on_free, virtpos, paired_from);
 }
 
@@ -2,6 +2,7 @@
 #define LDUMP_H
 
 #include "../list.h"
+#include "../compact/compact.h"
 #include "../../../libs/logging/logging.h"
 
 #include <stdio.h>
@@ -1,22 +1,131 @@
 #include "list.h"
+#include "compact/compact.h"
 
-#define ALLOC(type, action, extra_req, size, res)                             \
+#if defined(__GNUC__)
+#define PREFETCH(ptr) __builtin_prefetch((ptr), 0, 3)
+#else
+#define PREFETCH(ptr) ((void)(ptr))
+#endif
+
+// Walks kept in flight by list_walk_batch
+#define WALK_BATCH_LANES 16
+
+#define ALLOC(type, action, res)                                              \
     begin                                                                     \
-        type* alloced = action(extra_req, size);                              \
+        type* alloced = (type*)(action);                                      \
         if (!CHECK(ERROR, alloced != NULL, "alloc failed")) return ERR_ALLOC; \
         (res) = alloced;                                                      \
     end;
 
+static void page_release(const allocator_t* a, list_cow_page_t* page)
+{
+    if (page && atomic_fetch_sub_explicit(&page->refs, 1, memory_order_acq_rel) == 1)
+        mem_free(a, page, sizeof(*page));
+}
+
+// Chunk of slot i is about to change, its page stays with the snapshots only
+static inline void cow_drop(list_t* list, size_t i)
+{
+    const size_t k = i >> LIST_COW_SHIFT;
+    if (k >= list->pages_amount || !list->pages[k]) return;
+
+    page_release(list->allocator, list->pages[k]);
+    list->pages[k] = NULL;
+}
+
+// Must run before any write into slot i
+#define COW_TOUCH(list, i) cow_drop((list), (i))
+
+static void cow_drop_from(list_t* list, size_t first_chunk)
+{
+    for (size_t k = first_chunk; k < list->pages_amount; ++k)
+    {
+        page_release(list->allocator, list->pages[k]);
+        list->pages[k] = NULL;
+    }
+}
+
+// Copy of chunk k as it is now, holding one reference for the list
+static err_t cow_publish(list_t* list, size_t k)
+{
+    list_cow_page_t* page = (list_cow_page_t*)mem_alloc(list->allocator, sizeof(*page));
+    if (!CHECK(ERROR, page != NULL, "cow page alloc failed")) return ERR_ALLOC;
+
+    const size_t first  = k << LIST_COW_SHIFT;
+    const size_t amount = (list->list_capacity - first < LIST_COW_CHUNK) ?
+                          (list->list_capacity - first) : LIST_COW_CHUNK;
+
+    atomic_init(&page->refs, 1);
+    memcpy(page->data, list->data + first, amount * sizeof(*list->data));
+    if (list->compact)
+    {
+        // No link arrays in compact mode, the page gets its links from the runs
+        for (size_t j = 0; j < amount; ++j)
+        {
+            page->next[j] = compact_next(list, first + j);
+            page->prev[j] = compact_prev(list, first + j);
+        }
+    } else {
+        memcpy(page->next, list->next + first, amount * sizeof(*list->next));
+        memcpy(page->prev, list->prev + first, amount * sizeof(*list->prev));
+    }
+    list->pages[k] = page;
+    LIST_STAT(list, cow_chunks, 1);
+    return OK;
+}
+
+// Moves old_size bytes of *array into fresh of new_size bytes and frees the old block
+static void move_array(const allocator_t* a, void* fresh, void** array, size_t old_size)
+{
+    if (old_size) memcpy(fresh, *array, old_size);
+    mem_free(a, *array, old_size);
+    *array = fresh;
+}
+
 static err_t list_grow(list_t * const list)
 {
     if (!CHECK(ERROR, list, "list is null")) return ERR_BAD_ARG;
 
-    const size_t old_cap = list->list_capacity ? list->list_capacity : DEFAULT_LIST_SIZE;
+    const allocator_t* a = list->allocator;
+
+    const size_t cur_cap = list->list_capacity;
+    const size_t old_cap = cur_cap ? cur_cap : DEFAULT_LIST_SIZE;
     const size_t new_cap = old_cap * 2;
 
-    ALLOC(list_elem_t, realloc, list->data, new_cap * sizeof(*list->data), list->data);
-    ALLOC(size_t,      realloc, list->next, new_cap * sizeof(*list->next), list->next);
-    ALLOC(size_t,      realloc, list->prev, new_cap * sizeof(*list->prev), list->prev);
+    const bool links  = !list->compact;
+    const bool labels = list->labels != NULL;
+
+    // Every array is allocated before any is replaced, a failure leaves the list as it was
+    void* ndata   = mem_alloc(a, new_cap * sizeof(*list->data));
+    void* nlabels = labels ? mem_alloc(a, new_cap * sizeof(*list->labels)) : NULL;
+    void* nnext   = links  ? mem_alloc(a, new_cap * sizeof(*list->next))   : NULL;
+    void* nprev   = links  ? mem_alloc(a, new_cap * sizeof(*list->prev))   : NULL;
+    if (!CHECK(ERROR, ndata && (!labels || nlabels) && (!links || (nnext && nprev)), "grow alloc failed"))
+    {
+        mem_free(a, ndata,   new_cap * sizeof(*list->data));
+        mem_free(a, nlabels, new_cap * sizeof(*list->labels));
+        mem_free(a, nnext,   new_cap * sizeof(*list->next));
+        mem_free(a, nprev,   new_cap * sizeof(*list->prev));
+        return ERR_ALLOC;
+    }
+
+    cow_drop_from(list, cur_cap >> LIST_COW_SHIFT);
+    LIST_STAT(list, grows, 1);
+    LIST_STAT(list, bytes_grown, cur_cap * (sizeof(*list->data) + (labels ? sizeof(*list->labels) : 0) +
+                                            (links ? 2 * sizeof(size_t) : 0)));
+
+    move_array(a, ndata, (void**)&list->data, cur_cap * sizeof(*list->data));
+    if (labels) move_array(a, nlabels, (void**)&list->labels, cur_cap * sizeof(*list->labels));
+
+    if (!links)
+    {
+        memset(list->data + cur_cap, 0, (new_cap - cur_cap) * sizeof(*list->data));
+        list->list_capacity = new_cap;
+        return OK;
+    }
+
+    move_array(a, nnext, (void**)&list->next, cur_cap * sizeof(*list->next));
+    move_array(a, nprev, (void**)&list->prev, cur_cap * sizeof(*list->prev));
 
     for (size_t i = old_cap; i + 1 < new_cap; ++i) {
         list->next[i] = i + 1;
@@ -40,12 +149,24 @@ static inline int idx_valid(const list_t* list, size_t i)
 
 static inline int idx_is_free(const list_t* list, size_t i)
 {
+    if (list->compact) return compact_is_free(list, i);
     return i != 0 && list->prev[i] == LIST_FREE;
 }
 
+static inline size_t lnext(const list_t* list, size_t i)
+{
+    return list->compact ? compact_next(list, i) : list->next[i];
+}
+
+static inline size_t lprev(const list_t* list, size_t i)
+{
+    return list->compact ? compact_prev(list, i) : list->prev[i];
+}
+
 static err_t ensure_slot(list_t* list)
 {
-    if (list->free_index != 0) return OK;
+    if (list->compact && list->list_size + 1 < list->list_capacity) return OK;
+    if (!list->compact && list->free_index != 0) return OK;
     return list_grow(list);
 }
 
@@ -69,12 +190,20 @@ static void push_free(list_t* list, size_t i)
 }
 
 err_t list_ctor(list_t * const list)
+{
+    return list_ctor_alloc(list, NULL);
+}
+
+err_t list_ctor_alloc(list_t * const list, const allocator_t * const allocator)
 {
     if (!CHECK(ERROR, list, "list is null")) return ERR_BAD_ARG;
 
-    ALLOC(list_elem_t, calloc, DEFAULT_LIST_SIZE, sizeof(list_elem_t), list->data);
-    ALLOC(size_t,      calloc, DEFAULT_LIST_SIZE, sizeof(size_t),      list->next);
-    ALLOC(size_t,      calloc, DEFAULT_LIST_SIZE, sizeof(size_t),      list->prev);
+    *list = (list_t){ 0 };
+    list->allocator = allocator;
+
+    ALLOC(list_elem_t, mem_calloc(allocator, DEFAULT_LIST_SIZE, sizeof(list_elem_t)), list->data);
+    ALLOC(size_t,      mem_calloc(allocator, DEFAULT_LIST_SIZE, sizeof(size_t)),      list->next);
+    ALLOC(size_t,      mem_calloc(allocator, DEFAULT_LIST_SIZE, sizeof(size_t)),      list->prev);
 
     list->list_capacity  = DEFAULT_LIST_SIZE;
 
@@ -99,9 +228,17 @@ err_t list_ctor(list_t * const list)
 err_t list_dtor(list_t * const list)
 {
     if (!list) return OK;
-    free(list->data);
-    free(list->next);
-    free(list->prev);
+
+    const allocator_t* a   = list->allocator;
+    const size_t       cap = list->list_capacity;
+
+    cow_drop_from(list, 0);
+    mem_free(a, list->pages, list->pages_amount * sizeof(*list->pages));
+    mem_free(a, list->data, cap * sizeof(*list->data));
+    mem_free(a, list->next, cap * sizeof(*list->next));
+    mem_free(a, list->prev, cap * sizeof(*list->prev));
+    mem_free(a, list->labels, cap * sizeof(*list->labels));
+    compact_free(list);
     *list = (list_t){ 0 };
     return OK;
 }
@@ -123,11 +260,36 @@ static void dump_with_title(const list_t *list, const char *title_str)
                 "[File %s at line %d at %s] %s",                                  \
                        __FILE__, __LINE__, __PRETTY_FUNCTION__, (title_str)), 0))
 
+static err_t verify_compact(const list_t * const list)
+{
+    if (compact_verify(list) != OK) return ERR_CORRUPT;
+
+    const allocator_t* a   = list->allocator;
+    const size_t       cap = list->list_capacity;
+
+    list_t view  = *list;
+    view.compact = NULL;
+    view.next    = (size_t*)mem_alloc(a, cap * sizeof(size_t));
+    view.prev    = (size_t*)mem_alloc(a, cap * sizeof(size_t));
+
+    err_t rc = ERR_ALLOC;
+    if (CHECK(ERROR, view.next && view.prev, "verify: alloc links failed"))
+    {
+        view.free_index = compact_materialize(list, view.next, view.prev);
+        rc = list_verify(&view);
+    }
+
+    mem_free(a, view.next, cap * sizeof(size_t));
+    mem_free(a, view.prev, cap * sizeof(size_t));
+    return rc;
+}
+
 err_t list_verify(const list_t * const list)
 {
     if (!CHECKD(list != NULL, "verify: list is null")) return ERR_BAD_ARG;
     const size_t cap = list->list_capacity;
     if (!CHECKD(cap > 0, "verify: capacity is zero")) return ERR_CORRUPT;
+    if (list->compact) return verify_compact(list);
 
     const size_t head = list->next[0];
     const size_t tail = list->prev[0];
@@ -145,7 +307,9 @@ err_t list_verify(const list_t * const list)
     if (!CHECKD(list->next[tail] == head, 
                 "verify: tail->next != head")) return ERR_CORRUPT;
 
-    unsigned char *used = (unsigned char*)calloc(cap, 1);
+    const allocator_t* a = list->allocator;
+
+    unsigned char *used = (unsigned char*)mem_calloc(a, cap, 1);
     if (!CHECKD(used != NULL, 
                 "verify: alloc used failed")) return ERR_ALLOC;
 
@@ -153,13 +317,13 @@ err_t list_verify(const list_t * const list)
     for (size_t steps = 0; steps < cap; ++steps) {
         if (!CHECKD(idx_valid(list, cur), 
                     "verify: cur OOB")) 
-                        { free(used); return ERR_CORRUPT; }
+                        { mem_free(a, used, cap); return ERR_CORRUPT; }
         if (!CHECKD(!idx_is_free(list, cur), 
                     "verify: used node marked free")) 
-                        { free(used); return ERR_CORRUPT; }
+                        { mem_free(a, used, cap); return ERR_CORRUPT; }
         if (!CHECKD(!used[cur], 
                     "verify: revisit used node")) 
-                        { free(used); return ERR_CORRUPT; }
+                        { mem_free(a, used, cap); return ERR_CORRUPT; }
         used[cur] = 1;
         counted++;
 
@@ -168,20 +332,20 @@ err_t list_verify(const list_t * const list)
 
         if (!CHECKD(idx_valid(list, prv) && !idx_is_free(list, prv), 
                     "verify: prev invalid")) 
-                        { free(used); return ERR_CORRUPT; }
+                        { mem_free(a, used, cap); return ERR_CORRUPT; }
         if (!CHECKD(idx_valid(list, nxt) && !idx_is_free(list, nxt), 
                     "verify: next invalid")) 
-                        { free(used); return ERR_CORRUPT; }
+                        { mem_free(a, used, cap); return ERR_CORRUPT; }
         if (!CHECKD(list->next[prv] == cur, 
                     "verify: prev->next mismatch")) 
-                        { free(used); return ERR_CORRUPT; }
+                        { mem_free(a, used, cap); return ERR_CORRUPT; }
         if (!CHECKD(list->prev[nxt] == cur, 
                     "verify: next->prev mismatch")) 
-                        { free(used); return ERR_CORRUPT; }
+                        { mem_free(a, used, cap); return ERR_CORRUPT; }
 
         if (cur == tail) {
             if (!CHECKD(nxt == head, 
-                        "verify: tail doesn't link to head")) { free(used); return ERR_CORRUPT; }
+                        "verify: tail doesn't link to head")) { mem_free(a, used, cap); return ERR_CORRUPT; }
             break;
         }
 
@@ -190,30 +354,30 @@ err_t list_verify(const list_t * const list)
 
     if (!CHECKD(counted == list->list_size, 
                 "verify: size mismatch")) 
-                    { free(used); return ERR_CORRUPT; }
+                    { mem_free(a, used, cap); return ERR_CORRUPT; }
 
-    unsigned char *seen_free = (unsigned char*)calloc(cap, 1);
+    unsigned char *seen_free = (unsigned char*)mem_calloc(a, cap, 1);
     if (!CHECKD(seen_free != NULL, 
                 "verify: alloc free-set failed")) 
-                    { free(used); return ERR_ALLOC; }
+                    { mem_free(a, used, cap); return ERR_ALLOC; }
 
     size_t free_cnt = 0, f = list->free_index;
     for (size_t steps = 0; f != 0; ++steps) {
         if (!CHECKD(steps < cap, 
                     "verify: cycle in free chain")) 
-                        { free(used); free(seen_free); return ERR_CORRUPT; }
+                        { mem_free(a, used, cap); mem_free(a, seen_free, cap); return ERR_CORRUPT; }
         if (!CHECKD(idx_valid(list, f), 
                     "verify: free OOB")) 
-                        { free(used); free(seen_free); return ERR_CORRUPT; }
+                        { mem_free(a, used, cap); mem_free(a, seen_free, cap); return ERR_CORRUPT; }
         if (!CHECKD(idx_is_free(list, f), 
                     "verify: node in free chain not free")) 
-                        { free(used); free(seen_free); return ERR_CORRUPT; }
+                        { mem_free(a, used, cap); mem_free(a, seen_free, cap); return ERR_CORRUPT; }
         if (!CHECKD(!seen_free[f], 
                     "verify: revisit free node")) 
-                        { free(used); free(seen_free); return ERR_CORRUPT; }
+                        { mem_free(a, used, cap); mem_free(a, seen_free, cap); return ERR_CORRUPT; }
         if (!CHECKD(!used[f], 
                     "verify: free overlaps used")) 
-                        { free(used); free(seen_free); return ERR_CORRUPT; }
+                        { mem_free(a, used, cap); mem_free(a, seen_free, cap); return ERR_CORRUPT; }
         seen_free[f] = 1;
         free_cnt++;
         f = list->next[f];
@@ -221,9 +385,9 @@ err_t list_verify(const list_t * const list)
 
     if (!CHECKD(counted + free_cnt == (cap - 1), 
                 "verify: partition mismatch")) 
-                    { free(used); free(seen_free); return ERR_CORRUPT; }
+                    { mem_free(a, used, cap); mem_free(a, seen_free, cap); return ERR_CORRUPT; }
 
-    free(used); free(seen_free);
+    mem_free(a, used, cap); mem_free(a, seen_free, cap);
     return OK;
 }
 
@@ -241,7 +405,7 @@ err_t get_next(const list_t * const list, const size_t index, size_t * const ele
     if (!CHECK(ERROR, list && elem, "bad args"))         return ERR_BAD_ARG;
     if (!CHECK(ERROR, idx_valid(list, index), "range"))  return ERR_BAD_ARG;
     if (!CHECK(ERROR, !idx_is_free(list, index), "free"))return ERR_BAD_ARG;
-    *elem = list->next[index];
+    *elem = lnext(list, index);
     return OK;
 }
 
@@ -250,21 +414,21 @@ err_t get_prev(const list_t * const list, const size_t index, size_t * const ele
     if (!CHECK(ERROR, list && elem, "bad args"))         return ERR_BAD_ARG;
     if (!CHECK(ERROR, idx_valid(list, index), "range"))  return ERR_BAD_ARG;
     if (!CHECK(ERROR, !idx_is_free(list, index), "free"))return ERR_BAD_ARG;
-    *elem = list->prev[index];
+    *elem = lprev(list, index);
     return OK;
 }
 
 err_t get_head(const list_t * const list, size_t * const elem)
 {
     if (!CHECK(ERROR, list && elem, "bad args"))         return ERR_BAD_ARG;
-    *elem = list->next[0];
+    *elem = lnext(list, 0);
     return OK; 
 }
 
 err_t get_tail(const list_t * const list, size_t * const elem)
 {
     if (!CHECK(ERROR, list && elem, "bad args"))         return ERR_BAD_ARG;
-    *elem = list->prev[0];
+    *elem = lprev(list, 0);
     return OK; 
 }
 
@@ -286,6 +450,99 @@ static inline void unlink_node(list_t* L, size_t i)
     if (i == L->prev[0]) L->prev[0] = p;
 }
 
+// Density threshold base of the labeling: range of 2^i labels may hold (2 / T)^i nodes
+#define LIST_ORDER_T 1.25
+
+static void order_spread(list_t* L, size_t first, size_t count, uint64_t base, uint64_t width)
+{
+    const uint64_t gap = width / (count + 1);
+    LIST_STAT(L, relabels, count);
+    for (size_t j = 0; j < count; ++j, first = lnext(L, first))
+        L->labels[first] = base + (j + 1) * gap;
+}
+
+// Bender et al. list labeling: find the smallest aligned label range around n
+// that is not overflowing and spread its nodes evenly. Amortized O(log n)
+static void order_label_inserted(list_t* L, size_t n)
+{
+    const size_t head = lnext(L, 0);
+    const size_t tail = lprev(L, 0);
+
+    size_t left  = (n == head) ? 0 : lprev(L, n);
+    size_t right = (n == tail) ? 0 : lnext(L, n);
+
+    const uint64_t lo = left  ? L->labels[left]  : 0;
+    const uint64_t hi = right ? L->labels[right] : LIST_ORDER_SPACE;
+
+    if (hi - lo > 1)
+    {
+        L->labels[n] = lo + (hi - lo) / 2;
+        return;
+    }
+
+    size_t first     = n;
+    size_t count     = 1;
+    double threshold = 1.0;
+
+    for (unsigned i = 1; i <= LIST_ORDER_BITS; ++i)
+    {
+        const uint64_t width = (uint64_t)1 << i;
+        const uint64_t base  = lo & ~(width - 1);
+        threshold *= 2.0 / LIST_ORDER_T;
+
+        while (left && L->labels[left] >= base)
+        {
+            first = left;
+            left  = (left == head) ? 0 : lprev(L, left);
+            count++;
+        }
+        while (right && L->labels[right] < base + width)
+        {
+            right = (right == tail) ? 0 : lnext(L, right);
+            count++;
+        }
+
+        if ((double)count <= threshold || i == LIST_ORDER_BITS)
+        {
+            order_spread(L, first, count, base, width);
+            return;
+        }
+    }
+}
+
+// Too fragmented for runs: back to explicit links. The element change
+// already happened, so a failed expand keeps the list valid in compact mode
+// and the next insert or delete tries again
+static void compact_limit_runs(list_t* list)
+{
+    if (list->compact->runs_amount <= LIST_COMPACT_MAX_RUNS(list->list_capacity)) return;
+
+    const err_t rc = list_expand(list);
+    if (rc != OK)
+        log_printf(ERROR, "compact: %zu runs over the limit, expand failed (%d)",
+                   list->compact->runs_amount, (int)rc);
+}
+
+static err_t compact_ins_after(list_t* list, size_t index, list_elem_t elem)
+{
+    size_t n = 0;
+    const err_t rc = compact_link_after(list, index, &n);
+    if (rc != OK) return rc;
+
+    // Runs only change the links of the new slot and its neighbours
+    COW_TOUCH(list, 0);
+    COW_TOUCH(list, n);
+    COW_TOUCH(list, compact_prev(list, n));
+    COW_TOUCH(list, compact_next(list, n));
+
+    list->data[n] = elem;
+    LIST_STAT(list, inserts, 1);
+    if (list->labels) order_label_inserted(list, n);
+
+    compact_limit_runs(list);
+    return OK;
+}
+
 #define INS_MACROS                                                                              \
     if (!CHECK(ERROR, list, "null")) return ERR_BAD_ARG;                                        \
     if (!CHECK(ERROR, idx_valid(list, index), "range")) return ERR_BAD_ARG;                     \
@@ -295,22 +552,34 @@ static inline void unlink_node(list_t* L, size_t i)
 err_t ins_elem_after(list_t * const list, const size_t index, const list_elem_t elem)
 {
     INS_MACROS;
-    size_t n      = pop_free(list);
+
+    if (list->compact) return compact_ins_after(list, index, elem);
+
+    const size_t n = list->free_index;
+    COW_TOUCH(list, 0);
+    COW_TOUCH(list, n);
+    COW_TOUCH(list, (index == 0) ? list->prev[0] : index);
+    COW_TOUCH(list, (index == 0) ? list->next[0] : list->next[index]);
+
+    pop_free(list);
     list->data[n] = elem;
+    LIST_STAT(list, inserts, 1);
 
     
     if (list->list_size == 1)
     {
         list->next[0] = list->prev[0] = n;
         list->next[n] = list->prev[n] = n;
-        return OK;
+    } else {
+        size_t left  = (index == 0) ? list->prev[0] : index;
+        size_t right = (index == 0) ? list->next[0] : list->next[index];
+        link_between(list, left, n, right);
+
+        if (index == 0) list->next[0] = n;
+        if (index == list->prev[0]) list->prev[0] = n;
     }
-    size_t left  = (index == 0) ? list->prev[0] : index;
-    size_t right = (index == 0) ? list->next[0] : list->next[index];
-    link_between(list, left, n, right);
 
-    if (index == 0) list->next[0] = n;
-    if (index == list->prev[0]) list->prev[0] = n;
+    if (list->labels) order_label_inserted(list, n);
 
     return OK;
 }
@@ -319,7 +588,8 @@ err_t ins_elem_before(list_t * const list, const size_t index, const list_elem_t
 {
     INS_MACROS;
 
-    size_t before = (index == 0) ? list->prev[0] : list->prev[index];
+    size_t before = (index == 0)              ? lprev(list, 0) :
+                    (index == lnext(list, 0)) ? 0              : lprev(list, index);
     return ins_elem_after(list, before, elem);
 }
 
@@ -331,10 +601,31 @@ err_t del_elem(list_t * const list, const size_t index)
     if (!CHECK(ERROR, idx_valid(list, index) && index != 0, "range")) return ERR_BAD_ARG;
     if (!CHECK(ERROR, !idx_is_free(list, index), "already free")) return ERR_BAD_ARG;
 
+    if (list->compact)
+    {
+        COW_TOUCH(list, 0);
+        COW_TOUCH(list, index);
+        COW_TOUCH(list, compact_prev(list, index));
+        COW_TOUCH(list, compact_next(list, index));
+
+        const err_t rc = compact_unlink(list, index);
+        if (rc != OK) return rc;
+
+        list->data[index] = 0;
+        LIST_STAT(list, deletes, 1);
+        compact_limit_runs(list);
+        return OK;
+    }
+
     const size_t was_size = list->list_size;
     const size_t prv = list->prev[index];
     const size_t nxt = list->next[index];
 
+    COW_TOUCH(list, 0);
+    COW_TOUCH(list, index);
+    COW_TOUCH(list, prv);
+    COW_TOUCH(list, nxt);
+
     if (was_size == 1) {
         list->next[0] = 0;
         list->prev[0] = 0;
@@ -347,6 +638,7 @@ err_t del_elem(list_t * const list, const size_t index)
     }
 
     push_free(list, index);
+    LIST_STAT(list, deletes, 1);
     return OK;
 }
 
@@ -355,7 +647,7 @@ err_t push_front(list_t * const list, list_elem_t elem, size_t * const real_inde
     if (!CHECK(ERROR, list && real_index, "bad args")) return ERR_BAD_ARG;
     const err_t rc = ins_elem_after(list, 0, elem);
     if (rc != OK) return rc;
-    *real_index = list->next[0];
+    *real_index = lnext(list, 0);
     return OK;
 }
 
@@ -364,44 +656,42 @@ err_t push_back(list_t * const list, list_elem_t elem, size_t * const real_index
     if (!CHECK(ERROR, list && real_index, "bad args")) return ERR_BAD_ARG;
     const err_t rc = ins_elem_before(list, 0, elem);
     if (rc != OK) return rc;
-    *real_index = list->prev[0];
+    *real_index = lprev(list, 0);
     return OK;
 }
 
-#define LIST_LIN_FREE_MACROS \
-    free(list->data);        \
-    free(list->next);        \
-    free(list->prev);        \
+#define LIST_LIN_FREE_MACROS(data_p, next_p, prev_p, cap) \
+    mem_free(a, (data_p), (cap) * sizeof(list_elem_t));   \
+    mem_free(a, (next_p), (cap) * sizeof(size_t));        \
+    mem_free(a, (prev_p), (cap) * sizeof(size_t));        \
 
-#define LIST_LIN_MACROS   \
-    LIST_LIN_FREE_MACROS; \
-    list->data = ndata;   \
-    list->next = nnext;   \
-    list->prev = nprev;   \
+#define LIST_LIN_MACROS                                                              \
+    LIST_LIN_FREE_MACROS(list->data, list->next, list->prev, list->list_capacity);  \
+    list->data = ndata;                                                              \
+    list->next = nnext;                                                              \
+    list->prev = nprev;                                                              \
     list->list_capacity = newc;
 
-err_t list_linearize(list_t * const list)
+static size_t linear_capacity(const size_t size)
 {
-    if (!list) return ERR_BAD_ARG;
-
-    const size_t size = list->list_size;
     const size_t minc = DEFAULT_LIST_SIZE;
-    const size_t newc = (size + 1 < minc) ? minc : (size + 1);
-
-    list_elem_t *ndata = (list_elem_t*)calloc(newc, sizeof(*ndata));
-    size_t      *nnext = (size_t*)     calloc(newc, sizeof(*nnext));
-    size_t      *nprev = (size_t*)     calloc(newc, sizeof(*nprev));
+    return (size + 1 < minc) ? minc : (size + 1);
+}
 
-    if (!ndata || !nnext || !nprev) { LIST_LIN_FREE_MACROS; return ERR_ALLOC; }
+// Fills zeroed arrays of newc slots with src in logical order, returns new free_index
+static size_t build_linear(const list_t * const src, list_elem_t* ndata,
+                           size_t* nnext, size_t* nprev, const size_t newc)
+{
+    const size_t size = src->list_size;
 
     if (size > 0) 
     {
-        size_t cur = list->next[0];
+        size_t cur = lnext(src, 0);
 
         for (size_t pos = 1; pos <= size; ++pos) 
         {
-            ndata[pos] = list->data[cur];
-            cur = list->next[cur];
+            ndata[pos] = src->data[cur];
+            cur = lnext(src, cur);
         }
 
         for (size_t pos = 1; pos <= size; ++pos) 
@@ -417,25 +707,372 @@ err_t list_linearize(list_t * const list)
         nprev[0] = 0;
     }
 
-    if (newc > size + 1) 
+    if (newc <= size + 1) return 0;
+
+    const size_t start = size + 1;
+    for (size_t i = start; i + 1 < newc; ++i) 
+    {
+        nnext[i] = i + 1;
+        nprev[i] = LIST_FREE;
+    }
+    nnext[newc - 1] = 0;
+    nprev[newc - 1] = LIST_FREE;
+    return start;
+}
+
+err_t list_linearize(list_t * const list)
+{
+    if (!list) return ERR_BAD_ARG;
+    if (list->compact) return list_compact(list);
+
+    const size_t newc = linear_capacity(list->list_size);
+
+    const allocator_t* a = list->allocator;
+
+    list_elem_t *ndata = (list_elem_t*)mem_calloc(a, newc, sizeof(*ndata));
+    size_t      *nnext = (size_t*)     mem_calloc(a, newc, sizeof(*nnext));
+    size_t      *nprev = (size_t*)     mem_calloc(a, newc, sizeof(*nprev));
+
+    if (!ndata || !nnext || !nprev) { LIST_LIN_FREE_MACROS(ndata, nnext, nprev, newc); return ERR_ALLOC; }
+
+    uint64_t *nlabels = NULL;
+    if (list->labels)
     {
-        const size_t start = size + 1;
-        for (size_t i = start; i + 1 < newc; ++i) 
-        {
-            nnext[i] = i + 1;
-            nprev[i] = LIST_FREE;
-        }
-        nnext[newc - 1] = 0;
-        nprev[newc - 1] = LIST_FREE;
-        list->free_index = start;
-    } else {
-        list->free_index = 0;
+        nlabels = (uint64_t*)mem_calloc(a, newc, sizeof(*nlabels));
+        if (!nlabels) { LIST_LIN_FREE_MACROS(ndata, nnext, nprev, newc); return ERR_ALLOC; }
     }
 
+    list->free_index = build_linear(list, ndata, nnext, nprev, newc);
+    LIST_STAT(list, bytes_linearized, newc * (sizeof(*ndata) + sizeof(*nnext) + sizeof(*nprev)));
+
+    mem_free(a, list->labels, list->list_capacity * sizeof(*list->labels));
+    cow_drop_from(list, 0);
     LIST_LIN_MACROS;
 
+    list->labels = nlabels;
+    if (nlabels && list->list_size)
+        order_spread(list, lnext(list, 0), list->list_size, 0, LIST_ORDER_SPACE);
+
+    return OK;
+}
+
+err_t list_clone(list_t * const dst, const list_t * const src, const bool linearize)
+{
+    if (!CHECK(ERROR, dst && src && dst != src, "bad args")) return ERR_BAD_ARG;
+
+    const allocator_t* a    = src->allocator;
+    const size_t       newc = linearize ? linear_capacity(src->list_size) : src->list_capacity;
+
+    list_elem_t *ndata = (list_elem_t*)mem_calloc(a, newc, sizeof(*ndata));
+    size_t      *nnext = (size_t*)     mem_calloc(a, newc, sizeof(*nnext));
+    size_t      *nprev = (size_t*)     mem_calloc(a, newc, sizeof(*nprev));
+
+    if (!ndata || !nnext || !nprev) { LIST_LIN_FREE_MACROS(ndata, nnext, nprev, newc); return ERR_ALLOC; }
+
+    *dst = (list_t){ 0 };
+    dst->allocator = a;
+
+    if (linearize)
+    {
+        dst->free_index = build_linear(src, ndata, nnext, nprev, newc);
+    } else if (src->compact) {
+        memcpy(ndata, src->data, newc * sizeof(*ndata));
+        dst->free_index = compact_materialize(src, nnext, nprev);
+    } else {
+        memcpy(ndata, src->data, newc * sizeof(*ndata));
+        memcpy(nnext, src->next, newc * sizeof(*nnext));
+        memcpy(nprev, src->prev, newc * sizeof(*nprev));
+        dst->free_index = src->free_index;
+    }
+
+    dst->data          = ndata;
+    dst->next          = nnext;
+    dst->prev          = nprev;
+    dst->list_capacity = newc;
+    dst->list_size     = src->list_size;
+
+    if (src->labels && list_order_enable(dst) != OK)
+    {
+        list_dtor(dst);
+        return ERR_ALLOC;
+    }
+    if (src->labels && !linearize)
+        memcpy(dst->labels, src->labels, newc * sizeof(*dst->labels));
+
     return OK;
 }
 
 #undef LIST_LIN_MACROS
 #undef LIST_LIN_FREE_MACROS
+
+err_t list_compact(list_t * const list)
+{
+    if (!CHECK(ERROR, list, "list is null")) return ERR_BAD_ARG;
+
+    err_t rc = list_expand(list);
+    if (rc != OK) return rc;
+
+    rc = list_linearize(list);
+    if (rc != OK) return rc;
+
+    return compact_from_links(list);
+}
+
+err_t list_expand(list_t * const list)
+{
+    if (!CHECK(ERROR, list, "list is null")) return ERR_BAD_ARG;
+    if (!list->compact) return OK;
+
+    const allocator_t* a   = list->allocator;
+    const size_t       cap = list->list_capacity;
+
+    size_t* next = (size_t*)mem_alloc(a, cap * sizeof(*next));
+    size_t* prev = (size_t*)mem_alloc(a, cap * sizeof(*prev));
+    if (!CHECK(ERROR, next && prev, "links alloc failed"))
+    {
+        mem_free(a, next, cap * sizeof(*next));
+        mem_free(a, prev, cap * sizeof(*prev));
+        return ERR_ALLOC;
+    }
+
+    cow_drop_from(list, 0);
+    LIST_STAT(list, expands, 1);
+    list->free_index = compact_materialize(list, next, prev);
+    list->next       = next;
+    list->prev       = prev;
+    compact_free(list);
+    return OK;
+}
+
+err_t list_order_enable(list_t * const list)
+{
+    if (!CHECK(ERROR, list, "list is null")) return ERR_BAD_ARG;
+    if (list->labels) return OK;
+
+    list->labels = (uint64_t*)mem_calloc(list->allocator, list->list_capacity, sizeof(*list->labels));
+    if (!CHECK(ERROR, list->labels != NULL, "labels alloc failed")) return ERR_ALLOC;
+
+    if (list->list_size)
+        order_spread(list, lnext(list, 0), list->list_size, 0, LIST_ORDER_SPACE);
+    return OK;
+}
+
+err_t list_order_disable(list_t * const list)
+{
+    if (!CHECK(ERROR, list, "list is null")) return ERR_BAD_ARG;
+
+    mem_free(list->allocator, list->labels, list->list_capacity * sizeof(*list->labels));
+    list->labels = NULL;
+    return OK;
+}
+
+err_t list_order_before(const list_t * const list, const size_t a, const size_t b, bool * const before)
+{
+    if (!CHECK(ERROR, list && before, "bad args"))                   return ERR_BAD_ARG;
+    if (!CHECK(ERROR, list->labels != NULL, "order is not enabled")) return ERR_BAD_ARG;
+    if (!CHECK(ERROR, idx_valid(list, a) && idx_valid(list, b) && a && b, "range")) return ERR_BAD_ARG;
+    if (!CHECK(ERROR, !idx_is_free(list, a) && !idx_is_free(list, b), "free"))      return ERR_BAD_ARG;
+
+    *before = list->labels[a] < list->labels[b];
+    return OK;
+}
+
+err_t list_walk_batch(const list_t * const list, const size_t * const from, const size_t hops,
+                      const size_t n, size_t * const out)
+{
+    if (!CHECK(ERROR, list && ((from && out) || n == 0), "bad args")) return ERR_BAD_ARG;
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (!CHECK(ERROR, idx_valid(list, from[i]) && !idx_is_free(list, from[i]), "range"))
+            return ERR_BAD_ARG;
+    }
+
+    // next[tail] is the head again, a walk ends on the sentinel instead
+    const size_t tail = lprev(list, 0);
+
+    // Runs give next without a dependent load, nothing to overlap
+    if (list->compact)
+    {
+        for (size_t i = 0; i < n; ++i)
+        {
+            size_t cur = from[i];
+            for (size_t h = 0; h < hops && (cur != 0 || h == 0); ++h)
+                cur = (cur == tail) ? 0 : lnext(list, cur);
+            out[i] = cur;
+        }
+        return OK;
+    }
+
+    const size_t* next = list->next;
+    for (size_t base = 0; base < n; base += WALK_BATCH_LANES)
+    {
+        const size_t lanes = (n - base < WALK_BATCH_LANES) ? n - base : WALK_BATCH_LANES;
+
+        size_t cur[WALK_BATCH_LANES];
+        for (size_t l = 0; l < lanes; ++l)
+        {
+            cur[l] = from[base + l];
+            PREFETCH(&next[cur[l]]);
+        }
+
+        // One hop of every lane per round, a lane that stepped past the
+        // tail stays on the sentinel, one that starts on it goes to the head
+        size_t moving = lanes;
+        for (size_t h = 0; h < hops && moving > 0; ++h)
+        {
+            moving = 0;
+            for (size_t l = 0; l < lanes; ++l)
+            {
+                if (cur[l] == 0 && h > 0) continue;
+                cur[l] = (cur[l] == tail) ? 0 : next[cur[l]];
+                PREFETCH(&next[cur[l]]);
+                moving += (cur[l] != 0);
+            }
+        }
+        memcpy(out + base, cur, lanes * sizeof(*cur));
+    }
+    return OK;
+}
+
+err_t list_stats(const list_t * const list, list_stats_t * const out)
+{
+    if (!CHECK(ERROR, list && out, "bad args")) return ERR_BAD_ARG;
+
+    const size_t cap  = list->list_capacity;
+    const size_t size = list->list_size;
+
+    *out = (list_stats_t){ 0 };
+    out->size     = size;
+    out->capacity = cap;
+    out->counters = list->counters;
+
+    if (list->compact)
+    {
+        out->runs              = list->compact->runs_amount;
+        out->link_bytes        = list->compact->runs_capacity * sizeof(list_run_t);
+        out->free_chain_length = cap - 1 - size;
+    } else {
+        out->link_bytes = cap * (sizeof(*list->next) + sizeof(*list->prev));
+        for (size_t f = list->free_index; f != 0 && out->free_chain_length < cap; f = list->next[f])
+            out->free_chain_length++;
+    }
+
+    size_t cur          = lnext(list, 0);
+    double displacement = 0;
+    for (size_t pos = 1; pos <= size && cur != 0 && cur < cap; ++pos)
+    {
+        displacement += (cur > pos) ? (double)(cur - pos) : (double)(pos - cur);
+
+        const size_t nxt = lnext(list, cur);
+        if (pos < size && nxt != cur + 1) out->nonsequential_hops++;
+        cur = nxt;
+    }
+
+    out->fragmentation     = (size > 1) ? (double)out->nonsequential_hops / (double)(size - 1) : 0.0;
+    out->mean_displacement = (size > 0) ? displacement / (double)size : 0.0;
+    return OK;
+}
+
+err_t list_snapshot(list_t * const list, list_snapshot_t ** const snapshot)
+{
+    if (!CHECK(ERROR, list && snapshot, "bad args")) return ERR_BAD_ARG;
+
+    const allocator_t* a      = list->allocator;
+    const size_t       chunks = (list->list_capacity + LIST_COW_CHUNK - 1) >> LIST_COW_SHIFT;
+
+    if (list->pages_amount < chunks)
+    {
+        list_cow_page_t** pages = (list_cow_page_t**)mem_realloc(a, list->pages,
+                                                                 list->pages_amount * sizeof(*pages),
+                                                                 chunks * sizeof(*pages));
+        if (!CHECK(ERROR, pages != NULL, "cow page table alloc failed")) return ERR_ALLOC;
+
+        memset(pages + list->pages_amount, 0, (chunks - list->pages_amount) * sizeof(*pages));
+        list->pages        = pages;
+        list->pages_amount = chunks;
+    }
+
+    // Only chunks written since the previous snapshot are copied
+    for (size_t k = 0; k < chunks; ++k)
+        if (!list->pages[k] && cow_publish(list, k) != OK) return ERR_ALLOC;
+
+    list_snapshot_t* snap = (list_snapshot_t*)mem_calloc(a, 1, sizeof(*snap));
+    if (!CHECK(ERROR, snap != NULL, "snapshot alloc failed")) return ERR_ALLOC;
+
+    snap->pages = (list_cow_page_t**)mem_alloc(a, chunks * sizeof(*snap->pages));
+    if (!CHECK(ERROR, snap->pages != NULL, "snapshot page table alloc failed"))
+    {
+        mem_free(a, snap, sizeof(*snap));
+        return ERR_ALLOC;
+    }
+
+    for (size_t k = 0; k < chunks; ++k)
+    {
+        atomic_fetch_add_explicit(&list->pages[k]->refs, 1, memory_order_relaxed);
+        snap->pages[k] = list->pages[k];
+    }
+
+    snap->allocator     = a;
+    snap->pages_amount  = chunks;
+    snap->list_capacity = list->list_capacity;
+    snap->list_size     = list->list_size;
+
+    *snapshot = snap;
+    return OK;
+}
+
+err_t list_snapshot_release(list_snapshot_t * const snapshot)
+{
+    if (!snapshot) return OK;
+
+    const allocator_t* a = snapshot->allocator;
+    for (size_t k = 0; k < snapshot->pages_amount; ++k)
+        page_release(a, snapshot->pages[k]);
+
+    mem_free(a, snapshot->pages, snapshot->pages_amount * sizeof(*snapshot->pages));
+    mem_free(a, snapshot, sizeof(*snapshot));
+    return OK;
+}
+
+#define SNAP_READ(snap, field, i) \
+    ((snap)->pages[(i) >> LIST_COW_SHIFT]->field[(i) & (LIST_COW_CHUNK - 1)])
+
+#define SNAP_GET_MACROS                                                                    \
+    if (!CHECK(ERROR, snapshot && elem, "bad args"))                 return ERR_BAD_ARG;   \
+    if (!CHECK(ERROR, index < snapshot->list_capacity, "range"))     return ERR_BAD_ARG;   \
+    if (!CHECK(ERROR, index == 0 || SNAP_READ(snapshot, prev, index) != LIST_FREE,         \
+               "free"))                                              return ERR_BAD_ARG;
+
+err_t list_snapshot_get_elem(const list_snapshot_t * const snapshot, const size_t index, list_elem_t * const elem)
+{
+    SNAP_GET_MACROS;
+    *elem = SNAP_READ(snapshot, data, index);
+    return OK;
+}
+
+err_t list_snapshot_get_next(const list_snapshot_t * const snapshot, const size_t index, size_t * const elem)
+{
+    SNAP_GET_MACROS;
+    *elem = SNAP_READ(snapshot, next, index);
+    return OK;
+}
+
+err_t list_snapshot_get_prev(const list_snapshot_t * const snapshot, const size_t index, size_t * const elem)
+{
+    SNAP_GET_MACROS;
+    *elem = SNAP_READ(snapshot, prev, index);
+    return OK;
+}
+
+err_t list_snapshot_get_head(const list_snapshot_t * const snapshot, size_t * const elem)
+{
+    return list_snapshot_get_next(snapshot, 0, elem);
+}
+
+err_t list_snapshot_get_tail(const list_snapshot_t * const snapshot, size_t * const elem)
+{
+    return list_snapshot_get_prev(snapshot, 0, elem);
+}
+
+#undef SNAP_GET_MACROS
+#undef SNAP_READ
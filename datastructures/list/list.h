@@ -2,6 +2,7 @@
 #define LIST_H
 
 #include "../../libs/logging/logging.h"
+#include "../../libs/alloc/alloc.h"
 #include "../../libs/types.h"
 
 #include <stddef.h>
@@ -10,9 +11,36 @@
 #include <string.h>
 #include <stdint.h>
 #include <limits.h>
+#include <stdbool.h>
+#include <stdatomic.h>
 
 typedef int list_elem_t;
 
+typedef struct list_snapshot_t list_snapshot_t;
+typedef struct list_cow_page_t list_cow_page_t;
+typedef struct list_compact_t  list_compact_t;
+
+/*
+    Hot-path counters, only updated when built with -D __LIST_STATS__
+*/
+typedef struct
+{
+    size_t grows;
+    size_t bytes_grown;      // bytes copied into the grown arrays by list_grow
+    size_t bytes_linearized; // bytes rewritten by list_linearize
+    size_t inserts;
+    size_t deletes;
+    size_t relabels;         // order labels rewritten by relabeling
+    size_t cow_chunks;       // chunks copied into snapshot pages
+    size_t expands;          // compact mode fallbacks to explicit links
+} list_counters_t;
+
+#ifdef __LIST_STATS__
+    #define LIST_STAT(list, field, amount) ((list)->counters.field += (amount))
+#else
+    #define LIST_STAT(list, field, amount) ((void)0)
+#endif
+
 typedef struct
 {
     list_elem_t* data;
@@ -23,8 +51,74 @@ typedef struct
     size_t       list_size;
 
     size_t       free_index;
+
+    const allocator_t* allocator;
+    list_cow_page_t**  pages;
+    size_t             pages_amount;
+
+    uint64_t*          labels;
+
+    list_compact_t*    compact;
+
+    list_counters_t    counters;
 } list_t;
 
+typedef struct
+{
+    size_t          size;
+    size_t          capacity;
+    size_t          free_chain_length;
+    size_t          runs;               // run table size in compact mode, 0 otherwise
+    size_t          link_bytes;         // memory held by the link representation
+
+    size_t          nonsequential_hops; // next[i] != i + 1 along the list
+    double          fragmentation;      // nonsequential_hops / (size - 1)
+    double          mean_displacement;  // mean |physical - logical| position
+
+    list_counters_t counters;
+} list_stats_t;
+
+// Order-maintenance labels live in (0, 2^LIST_ORDER_BITS)
+#define LIST_ORDER_BITS   62
+#define LIST_ORDER_SPACE  ((uint64_t)1 << LIST_ORDER_BITS)
+
+#define LIST_COW_SHIFT 6
+#define LIST_COW_CHUNK ((size_t)1 << LIST_COW_SHIFT)
+
+/*
+    Immutable copy of one chunk of slots, shared by the list and its
+    snapshots. Nobody writes a page once it is published, the last
+    reference frees it
+*/
+struct list_cow_page_t
+{
+    atomic_size_t refs;
+    list_elem_t   data[LIST_COW_CHUNK];
+    size_t        next[LIST_COW_CHUNK];
+    size_t        prev[LIST_COW_CHUNK];
+};
+
+/*
+    Copy-on-write snapshot of a list. The list keeps a page for every chunk
+    it has not written since the last snapshot, a write only drops the
+    list's reference. Taking a snapshot copies the chunks written since the
+    previous one and references the rest, so a snapshot reads nothing but
+    its own pages and may be read on another thread while the list goes on
+    changing. A compact list stays compact, its pages get links from the
+    runs. list_snapshot runs on the writer thread, release may run on any
+    thread as long as the allocator is thread-safe
+*/
+struct list_snapshot_t
+{
+    const allocator_t* allocator;
+
+    list_cow_page_t**  pages;
+    size_t             pages_amount;
+
+    size_t             list_capacity;
+    size_t             list_size;
+};
+
 #define DEFAULT_LIST_SIZE 4
 #define LIST_FREE ((size_t)-1)
 
@@ -32,7 +126,8 @@ typedef struct
     list_t list_name = { 0 };  \
     list_ctor(&(list_name))
 
-err_t list_ctor(list_t * const list);
+err_t list_ctor      (list_t * const list);
+err_t list_ctor_alloc(list_t * const list, const allocator_t * const allocator);
 err_t list_dtor(list_t * const list);
 
 err_t list_verify(const list_t * const list);
@@ -53,4 +148,33 @@ err_t push_back (list_t * const list, list_elem_t elem, size_t * const real_inde
 
 err_t list_linearize(list_t * const list);
 
+err_t list_compact(list_t * const list);
+err_t list_expand (list_t * const list);
+
+err_t list_order_enable (list_t * const list);
+err_t list_order_disable(list_t * const list);
+err_t list_order_before (const list_t * const list, const size_t a, const size_t b, bool * const before);
+
+err_t list_stats(const list_t * const list, list_stats_t * const out);
+
+/*
+    out[i] is the index hops steps after from[i] along next, or 0 once the
+    walk steps past the tail (it does not wrap to the head), from[i] = 0
+    walks from the head. Walks go 16 at a time in lockstep, each one
+    prefetching its next link, so their cache misses overlap
+*/
+err_t list_walk_batch(const list_t * const list, const size_t * const from, const size_t hops,
+                      const size_t n, size_t * const out);
+
+err_t list_clone(list_t * const dst, const list_t * const src, const bool linearize);
+
+err_t list_snapshot        (list_t * const list, list_snapshot_t ** const snapshot);
+err_t list_snapshot_release(list_snapshot_t * const snapshot);
+
+err_t list_snapshot_get_elem(const list_snapshot_t * const snapshot, const size_t index, list_elem_t * const elem);
+err_t list_snapshot_get_next(const list_snapshot_t * const snapshot, const size_t index, size_t * const elem);
+err_t list_snapshot_get_prev(const list_snapshot_t * const snapshot, const size_t index, size_t * const elem);
+err_t list_snapshot_get_head(const list_snapshot_t * const snapshot, size_t * const elem);
+err_t list_snapshot_get_tail(const list_snapshot_t * const snapshot, size_t * const elem);
+
 #endif
@@ -0,0 +1,553 @@
+#include "radix.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define IS_LEAF(ptr)  (((uintptr_t)(ptr)) & 1)
+#define AS_LEAF(ptr)  ((radix_leaf_t*)((uintptr_t)(ptr) & ~(uintptr_t)1))
+#define TAG_LEAF(ptr) ((radix_node_t*)((uintptr_t)(ptr) | 1))
+
+#define AS_N4(node)   ((radix_node4_t*)(node))
+#define AS_N16(node)  ((radix_node16_t*)(node))
+#define AS_N48(node)  ((radix_node48_t*)(node))
+#define AS_N256(node) ((radix_node256_t*)(node))
+
+#define SCAN_INLINE_FRAMES 64
+
+static const size_t node_sizes[4] = {
+    sizeof(radix_node4_t), sizeof(radix_node16_t), sizeof(radix_node48_t), sizeof(radix_node256_t)
+};
+
+static const size_t node_capacity[4] = { 4, 16, 48, 256 };
+
+static inline size_t min_size(const size_t a, const size_t b)
+{
+    return a < b ? a : b;
+}
+
+static radix_node_t* node_alloc(radix_t * const tree, const radix_type_t type)
+{
+    void* node = tree->free_nodes[type];
+    if (node != NULL) {
+        memcpy(&tree->free_nodes[type], node, sizeof(void*));
+    } else {
+        node = slab_carve(&tree->slab, tree->allocator, node_sizes[type], sizeof(void*));
+        if (!CHECK(ERROR, node != NULL, "radix: node alloc failed (type %d)", (int)type))
+            return NULL;
+    }
+
+    memset(node, 0, node_sizes[type]);
+    ((radix_node_t*)node)->type = (uint8_t)type;
+    tree->nodes_amount[type] += 1;
+    return (radix_node_t*)node;
+}
+
+static void node_free(radix_t * const tree, radix_node_t * const node)
+{
+    const radix_type_t type = (radix_type_t)node->type;
+    memcpy(node, &tree->free_nodes[type], sizeof(void*));
+    tree->free_nodes[type]    = node;
+    tree->nodes_amount[type] -= 1;
+}
+
+static radix_leaf_t* leaf_alloc(radix_t * const tree, const char * const key, const size_t len,
+                                const radix_value_t value)
+{
+    radix_leaf_t* leaf = (radix_leaf_t*)slab_carve(&tree->slab, tree->allocator,
+                                                   sizeof(radix_leaf_t) + len, sizeof(void*));
+    if (!CHECK(ERROR, leaf != NULL, "radix: leaf alloc failed (%zu)", len))
+        return NULL;
+
+    leaf->value = value;
+    leaf->len   = (uint32_t)len;
+    memcpy(leaf->key, key, len);
+
+    tree->key_bytes += len;
+    return leaf;
+}
+
+static radix_node_t** find_child(radix_node_t * const node, const uint8_t c)
+{
+    switch (node->type)
+    {
+        case RADIX_NODE4:
+        {
+            radix_node4_t* n = AS_N4(node);
+            for (size_t i = 0; i < node->children; ++i)
+                if (n->keys[i] == c) return &n->children[i];
+            return NULL;
+        }
+        case RADIX_NODE16:
+        {
+            radix_node16_t* n = AS_N16(node);
+#if defined(__SSE2__)
+            const __m128i cmp  = _mm_cmpeq_epi8(_mm_set1_epi8((char)c),
+                                                _mm_loadu_si128((const __m128i*)n->keys));
+            const unsigned mask = (unsigned)_mm_movemask_epi8(cmp) & ((1u << node->children) - 1);
+            return mask ? &n->children[__builtin_ctz(mask)] : NULL;
+#else
+            for (size_t i = 0; i < node->children; ++i)
+                if (n->keys[i] == c) return &n->children[i];
+            return NULL;
+#endif
+        }
+        case RADIX_NODE48:
+        {
+            radix_node48_t* n = AS_N48(node);
+            return n->index[c] ? &n->children[n->index[c] - 1] : NULL;
+        }
+        case RADIX_NODE256:
+        {
+            radix_node256_t* n = AS_N256(node);
+            return n->children[c] ? &n->children[c] : NULL;
+        }
+        default:
+            return NULL;
+    }
+}
+
+static const radix_leaf_t* minimum(const radix_node_t* node)
+{
+    while (node != NULL && !IS_LEAF(node))
+    {
+        switch (node->type)
+        {
+            case RADIX_NODE4:  node = AS_N4 (node)->children[0]; break;
+            case RADIX_NODE16: node = AS_N16(node)->children[0]; break;
+            case RADIX_NODE48:
+            {
+                const radix_node48_t* n = AS_N48(node);
+                size_t c = 0;
+                while (n->index[c] == 0) c++;
+                node = n->children[n->index[c] - 1];
+                break;
+            }
+            case RADIX_NODE256:
+            {
+                const radix_node256_t* n = AS_N256(node);
+                size_t c = 0;
+                while (n->children[c] == NULL) c++;
+                node = n->children[c];
+                break;
+            }
+            default:
+                return NULL;
+        }
+    }
+    return node ? AS_LEAF(node) : NULL;
+}
+
+// Length of the match between the node path and key + depth
+static size_t prefix_mismatch(const radix_node_t * const node, const char * const key,
+                              const size_t len, const size_t depth)
+{
+    const uint8_t* bytes = (const uint8_t*)key + depth;
+
+    size_t limit = min_size(min_size(RADIX_PREFIX, node->prefix_len), len - depth);
+    size_t i     = 0;
+    for (; i < limit; ++i)
+        if (node->prefix[i] != bytes[i]) return i;
+
+    if (node->prefix_len > RADIX_PREFIX)
+    {
+        const radix_leaf_t* leaf = minimum(node);
+        limit = min_size(node->prefix_len, min_size(leaf->len, len) - depth);
+        for (; i < limit; ++i)
+            if ((uint8_t)leaf->key[depth + i] != bytes[i]) return i;
+    }
+    return i;
+}
+
+static radix_node_t* grow(radix_t * const tree, radix_node_t * const node)
+{
+    radix_node_t* bigger = node_alloc(tree, (radix_type_t)(node->type + 1));
+    if (bigger == NULL) return NULL;
+
+    memcpy(bigger->prefix, node->prefix, RADIX_PREFIX);
+    bigger->prefix_len = node->prefix_len;
+    bigger->children   = node->children;
+
+    switch (node->type)
+    {
+        case RADIX_NODE4:
+            memcpy(AS_N16(bigger)->keys,     AS_N4(node)->keys,     4);
+            memcpy(AS_N16(bigger)->children, AS_N4(node)->children, 4 * sizeof(radix_node_t*));
+            break;
+        case RADIX_NODE16:
+            for (size_t i = 0; i < 16; ++i)
+            {
+                AS_N48(bigger)->index[AS_N16(node)->keys[i]] = (uint8_t)(i + 1);
+                AS_N48(bigger)->children[i] = AS_N16(node)->children[i];
+            }
+            break;
+        case RADIX_NODE48:
+            for (size_t c = 0; c < 256; ++c)
+                if (AS_N48(node)->index[c])
+                    AS_N256(bigger)->children[c] = AS_N48(node)->children[AS_N48(node)->index[c] - 1];
+            break;
+        default:
+            break;
+    }
+
+    node_free(tree, node);
+    return bigger;
+}
+
+// *ref is node, replaced when the node has to grow
+static err_t add_child(radix_t * const tree, radix_node_t ** const ref, const uint8_t c,
+                       radix_node_t * const child)
+{
+    radix_node_t* node = *ref;
+
+    if (node->children == node_capacity[node->type])
+    {
+        node = grow(tree, node);
+        if (node == NULL) return ERR_ALLOC;
+        *ref = node;
+    }
+
+    switch (node->type)
+    {
+        case RADIX_NODE4:
+        case RADIX_NODE16:
+        {
+            uint8_t*       keys     = (node->type == RADIX_NODE4) ? AS_N4(node)->keys     : AS_N16(node)->keys;
+            radix_node_t** children = (node->type == RADIX_NODE4) ? AS_N4(node)->children : AS_N16(node)->children;
+
+            size_t pos = 0;
+            while (pos < node->children && keys[pos] < c) pos++;
+
+            memmove(keys + pos + 1,     keys + pos,     node->children - pos);
+            memmove(children + pos + 1, children + pos, (node->children - pos) * sizeof(radix_node_t*));
+            keys[pos]     = c;
+            children[pos] = child;
+            break;
+        }
+        case RADIX_NODE48:
+            // Nothing is removed, so slots fill in order
+            AS_N48(node)->children[node->children] = child;
+            AS_N48(node)->index[c] = (uint8_t)(node->children + 1);
+            break;
+        case RADIX_NODE256:
+            AS_N256(node)->children[c] = child;
+            break;
+        default:
+            return ERR_CORRUPT;
+    }
+
+    node->children += 1;
+    return OK;
+}
+
+err_t radix_ctor(radix_t * const tree, const allocator_t * const allocator)
+{
+    if (!CHECK(ERROR, tree != NULL, "radix_ctor: tree is NULL"))
+        return ERR_BAD_ARG;
+
+    memset(tree, 0, sizeof(*tree));
+    tree->allocator = allocator;
+    slab_init(&tree->slab, sizeof(radix_node4_t));
+    return OK;
+}
+
+err_t radix_dtor(radix_t * const tree)
+{
+    if (!CHECK(ERROR, tree != NULL, "radix_dtor: tree is NULL"))
+        return ERR_BAD_ARG;
+
+    slab_clear(&tree->slab, tree->allocator);
+
+    tree->root      = NULL;
+    tree->size      = 0;
+    tree->key_bytes = 0;
+    memset(tree->nodes_amount, 0, sizeof(tree->nodes_amount));
+    memset(tree->free_nodes,   0, sizeof(tree->free_nodes));
+    return OK;
+}
+
+err_t radix_insert(radix_t * const tree, const char * const key, const radix_value_t value)
+{
+    if (!CHECK(ERROR, tree != NULL && key != NULL, "radix_insert: bad args"))
+        return ERR_BAD_ARG;
+
+    const size_t   len   = strlen(key) + 1;
+    const uint8_t* bytes = (const uint8_t*)key;
+
+    radix_node_t** ref   = &tree->root;
+    size_t         depth = 0;
+
+    for (;;)
+    {
+        radix_node_t* node = *ref;
+
+        if (node == NULL)
+        {
+            radix_leaf_t* leaf = leaf_alloc(tree, key, len, value);
+            if (leaf == NULL) return ERR_ALLOC;
+
+            *ref = TAG_LEAF(leaf);
+            tree->size += 1;
+            return OK;
+        }
+
+        if (IS_LEAF(node))
+        {
+            radix_leaf_t* old = AS_LEAF(node);
+            if (old->len == len && memcmp(old->key, key, len) == 0)
+            {
+                old->value = value;
+                return OK;
+            }
+
+            // Both keys end with a zero, they differ before either one ends
+            size_t common = 0;
+            while ((uint8_t)old->key[depth + common] == bytes[depth + common]) common++;
+
+            // Leaf bytes can not be handed back to the slab, the leaf is the last allocation
+            radix_node_t* split = node_alloc(tree, RADIX_NODE4);
+            if (split == NULL) return ERR_ALLOC;
+
+            radix_leaf_t* leaf = leaf_alloc(tree, key, len, value);
+            if (leaf == NULL)
+            {
+                node_free(tree, split);
+                return ERR_ALLOC;
+            }
+
+            split->prefix_len = (uint32_t)common;
+            memcpy(split->prefix, bytes + depth, min_size(common, RADIX_PREFIX));
+
+            (void)add_child(tree, &split, (uint8_t)old->key[depth + common], node);
+            (void)add_child(tree, &split, bytes[depth + common], TAG_LEAF(leaf));
+
+            *ref = split;
+            tree->size += 1;
+            return OK;
+        }
+
+        if (node->prefix_len != 0)
+        {
+            const size_t match = prefix_mismatch(node, key, len, depth);
+            if (match < node->prefix_len)
+            {
+                radix_node_t* split = node_alloc(tree, RADIX_NODE4);
+                if (split == NULL) return ERR_ALLOC;
+
+                radix_leaf_t* leaf = leaf_alloc(tree, key, len, value);
+                if (leaf == NULL)
+                {
+                    node_free(tree, split);
+                    return ERR_ALLOC;
+                }
+
+                split->prefix_len = (uint32_t)match;
+                memcpy(split->prefix, node->prefix, min_size(match, RADIX_PREFIX));
+
+                // node keeps the path after the branching byte
+                uint8_t branch = 0;
+                if (node->prefix_len <= RADIX_PREFIX) {
+                    branch = node->prefix[match];
+                    node->prefix_len -= (uint32_t)(match + 1);
+                    memmove(node->prefix, node->prefix + match + 1, min_size(node->prefix_len, RADIX_PREFIX));
+                } else {
+                    const radix_leaf_t* min = minimum(node);
+                    branch = (uint8_t)min->key[depth + match];
+                    node->prefix_len -= (uint32_t)(match + 1);
+                    memcpy(node->prefix, min->key + depth + match + 1, min_size(node->prefix_len, RADIX_PREFIX));
+                }
+
+                (void)add_child(tree, &split, branch, node);
+                (void)add_child(tree, &split, bytes[depth + match], TAG_LEAF(leaf));
+
+                *ref = split;
+                tree->size += 1;
+                return OK;
+            }
+            depth += node->prefix_len;
+        }
+
+        if (!CHECK(ERROR, depth < len, "radix_insert: key ended inside the tree"))
+            return ERR_CORRUPT;
+
+        radix_node_t** child = find_child(node, bytes[depth]);
+        if (child == NULL)
+        {
+            if (node->children == node_capacity[node->type])
+            {
+                node = grow(tree, node);
+                if (node == NULL) return ERR_ALLOC;
+                *ref = node;
+            }
+
+            radix_leaf_t* leaf = leaf_alloc(tree, key, len, value);
+            if (leaf == NULL) return ERR_ALLOC;
+
+            const err_t rc = add_child(tree, ref, bytes[depth], TAG_LEAF(leaf));
+            if (rc == OK) tree->size += 1;
+            return rc;
+        }
+
+        ref    = child;
+        depth += 1;
+    }
+}
+
+err_t radix_find(const radix_t * const tree, const char * const key, radix_value_t * const value)
+{
+    if (!CHECK(ERROR, tree != NULL && key != NULL, "radix_find: bad args"))
+        return ERR_BAD_ARG;
+
+    const size_t   len   = strlen(key) + 1;
+    const uint8_t* bytes = (const uint8_t*)key;
+
+    radix_node_t* node  = tree->root;
+    size_t        depth = 0;
+
+    while (node != NULL)
+    {
+        if (IS_LEAF(node))
+        {
+            const radix_leaf_t* leaf = AS_LEAF(node);
+            if (leaf->len != len || memcmp(leaf->key, key, len) != 0) return ERR_NOT_FOUND;
+
+            if (value) *value = leaf->value;
+            return OK;
+        }
+
+        // Optimistic: path bytes past RADIX_PREFIX are confirmed on the leaf
+        if (node->prefix_len != 0)
+        {
+            if (node->prefix_len >= len - depth) return ERR_NOT_FOUND;
+
+            const size_t limit = min_size(node->prefix_len, RADIX_PREFIX);
+            if (memcmp(node->prefix, bytes + depth, limit) != 0) return ERR_NOT_FOUND;
+            depth += node->prefix_len;
+        }
+
+        radix_node_t** child = find_child(node, bytes[depth]);
+        node   = child ? *child : NULL;
+        depth += 1;
+    }
+    return ERR_NOT_FOUND;
+}
+
+typedef struct
+{
+    const radix_node_t* node;
+    size_t              next;
+} scan_frame_t;
+
+// Visit every leaf under root in byte order with an explicit stack
+static err_t scan(const radix_t * const tree, const radix_node_t * const root,
+                  radix_visit_t visit, void * const ctx)
+{
+    if (IS_LEAF(root))
+        return visit(AS_LEAF(root)->key, AS_LEAF(root)->value, ctx);
+
+    scan_frame_t  inline_frames[SCAN_INLINE_FRAMES];
+    scan_frame_t* frames   = inline_frames;
+    size_t        capacity = SCAN_INLINE_FRAMES;
+    size_t        head     = 0;
+    err_t         rc       = OK;
+
+    frames[head++] = (scan_frame_t){ root, 0 };
+    while (head > 0 && rc == OK)
+    {
+        scan_frame_t*       frame = &frames[head - 1];
+        const radix_node_t* node  = frame->node;
+        const radix_node_t* child = NULL;
+
+        switch (node->type)
+        {
+            case RADIX_NODE4:
+                if (frame->next < node->children) child = AS_N4(node)->children[frame->next++];
+                break;
+            case RADIX_NODE16:
+                if (frame->next < node->children) child = AS_N16(node)->children[frame->next++];
+                break;
+            case RADIX_NODE48:
+                while (frame->next < 256 && AS_N48(node)->index[frame->next] == 0) frame->next++;
+                if (frame->next < 256)
+                    child = AS_N48(node)->children[AS_N48(node)->index[frame->next++] - 1];
+                break;
+            case RADIX_NODE256:
+                while (frame->next < 256 && AS_N256(node)->children[frame->next] == NULL) frame->next++;
+                if (frame->next < 256) child = AS_N256(node)->children[frame->next++];
+                break;
+            default:
+                rc = ERR_CORRUPT;
+                break;
+        }
+
+        if (child == NULL) {
+            head--;
+        } else if (IS_LEAF(child)) {
+            rc = visit(AS_LEAF(child)->key, AS_LEAF(child)->value, ctx);
+        } else {
+            if (head == capacity)
+            {
+                scan_frame_t* grown = (scan_frame_t*)mem_alloc(tree->allocator, 2 * capacity * sizeof(scan_frame_t));
+                if (!CHECK(ERROR, grown != NULL, "radix: scan stack alloc failed (%zu)", 2 * capacity))
+                {
+                    rc = ERR_ALLOC;
+                    break;
+                }
+
+                memcpy(grown, frames, head * sizeof(scan_frame_t));
+                if (frames != inline_frames) mem_free(tree->allocator, frames, capacity * sizeof(scan_frame_t));
+                frames    = grown;
+                capacity *= 2;
+            }
+            frames[head++] = (scan_frame_t){ child, 0 };
+        }
+    }
+
+    if (frames != inline_frames) mem_free(tree->allocator, frames, capacity * sizeof(scan_frame_t));
+    return rc;
+}
+
+err_t radix_prefix_scan(const radix_t * const tree, const char * const prefix,
+                        radix_visit_t visit, void * const ctx)
+{
+    if (!CHECK(ERROR, tree != NULL && prefix != NULL && visit != NULL, "radix_prefix_scan: bad args"))
+        return ERR_BAD_ARG;
+
+    const size_t   len   = strlen(prefix);
+    const uint8_t* bytes = (const uint8_t*)prefix;
+
+    radix_node_t* node  = tree->root;
+    size_t        depth = 0;
+
+    while (node != NULL)
+    {
+        if (IS_LEAF(node))
+        {
+            const radix_leaf_t* leaf = AS_LEAF(node);
+            if (leaf->len > len && memcmp(leaf->key, prefix, len) == 0)
+                return visit(leaf->key, leaf->value, ctx);
+            return OK;
+        }
+
+        if (depth == len) return scan(tree, node, visit, ctx);
+
+        if (node->prefix_len != 0)
+        {
+            // Only the part of the path the prefix covers has to match
+            const size_t need = min_size(node->prefix_len, len - depth);
+            if (prefix_mismatch(node, prefix, depth + need, depth) < need) return OK;
+            if (depth + node->prefix_len >= len) return scan(tree, node, visit, ctx);
+            depth += node->prefix_len;
+        }
+
+        radix_node_t** child = find_child(node, bytes[depth]);
+        node   = child ? *child : NULL;
+        depth += 1;
+    }
+    return OK;
+}
+
+err_t radix_foreach(const radix_t * const tree, radix_visit_t visit, void * const ctx)
+{
+    return radix_prefix_scan(tree, "", visit, ctx);
+}
@@ -0,0 +1,116 @@
+#ifndef RADIX_H
+#define RADIX_H
+
+#include "../../libs/logging/logging.h"
+#include "../../libs/alloc/alloc.h"
+#include "../../libs/types.h"
+
+#include "../tree/slab/slab.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+// Compressed path bytes kept in the node, longer paths are checked on the leaf
+#define RADIX_PREFIX 8
+
+typedef uint64_t radix_value_t;
+
+typedef enum
+{
+    RADIX_NODE4   = 0,
+    RADIX_NODE16  = 1,
+    RADIX_NODE48  = 2,
+    RADIX_NODE256 = 3,
+} radix_type_t;
+
+typedef struct
+{
+    uint8_t  type;
+    uint8_t  pad;
+    uint16_t children;
+    uint32_t prefix_len;
+    uint8_t  prefix[RADIX_PREFIX];
+} radix_node_t;
+
+/*
+    Children are node pointers or leaf pointers tagged with the low bit.
+    NODE4 and NODE16 keep keys sorted, NODE48 maps a byte to slot + 1
+*/
+typedef struct
+{
+    radix_node_t  hdr;
+    uint8_t       keys[4];
+    radix_node_t* children[4];
+} radix_node4_t;
+
+typedef struct
+{
+    radix_node_t  hdr;
+    uint8_t       keys[16];
+    radix_node_t* children[16];
+} radix_node16_t;
+
+typedef struct
+{
+    radix_node_t  hdr;
+    uint8_t       index[256];
+    radix_node_t* children[48];
+} radix_node48_t;
+
+typedef struct
+{
+    radix_node_t  hdr;
+    radix_node_t* children[256];
+} radix_node256_t;
+
+// len counts the terminating zero, so no stored key is a prefix of another
+typedef struct
+{
+    radix_value_t value;
+    uint32_t      len;
+    char          key[];
+} radix_leaf_t;
+
+/*
+    Adaptive radix tree (ART) over C strings in byte order. Nodes and leaves
+    are carved from a per-tree slab, outgrown nodes wait in per-type free lists
+*/
+typedef struct
+{
+    radix_node_t*      root;
+    size_t             size;
+
+    size_t             nodes_amount[4];
+    size_t             key_bytes;
+    void*              free_nodes[4];
+
+    const allocator_t* allocator;
+    tslab_t            slab;
+} radix_t;
+
+typedef err_t (*radix_visit_t)(const char * const key, const radix_value_t value, void * const ctx);
+
+#define CREATE_RADIX(tree_name)   \
+    radix_t tree_name = { 0 };    \
+    radix_ctor(&(tree_name), NULL)
+
+err_t radix_ctor(radix_t * const tree, const allocator_t * const allocator);
+err_t radix_dtor(radix_t * const tree);
+
+/*
+    Insert key or overwrite the value of an existing one
+*/
+err_t radix_insert(radix_t * const tree, const char * const key, const radix_value_t value);
+err_t radix_find  (const radix_t * const tree, const char * const key, radix_value_t * const value);
+
+/*
+    Visit keys starting with prefix in byte order, stops at the first
+    visit that does not return OK and passes its code on
+*/
+err_t radix_prefix_scan(const radix_t * const tree, const char * const prefix,
+                        radix_visit_t visit, void * const ctx);
+err_t radix_foreach    (const radix_t * const tree, radix_visit_t visit, void * const ctx);
+
+#endif
@@ -0,0 +1,480 @@
+#include "concurrent.h"
+
+// One update copies at most the path plus two nodes per rotation level
+#define OP_MAX_NODES (4 * (TREE_MAX_HEIGHT + 2))
+
+typedef struct
+{
+    ctree_t*        tree;
+
+    node_t*         fresh  [OP_MAX_NODES];
+    size_t          fresh_amount;
+    ctree_retired_t retired[OP_MAX_NODES];
+    size_t          retired_amount;
+
+    node_t*         leaf; // inserted node, its key bytes go back on rollback
+    bool            failed;
+} op_t;
+
+static inline int height_of(const node_t* node)
+{
+    return node ? node->height : 0;
+}
+
+static inline void update(node_t* node)
+{
+    const int hl = height_of(node->left);
+    const int hr = height_of(node->right);
+    node->height = 1 + (hl > hr ? hl : hr);
+}
+
+static void retire(op_t * const op, void * const ptr, const size_t size)
+{
+    op->retired[op->retired_amount++] = (ctree_retired_t){ ptr, size };
+}
+
+// Make *link a node private to this update, copying it if it is published
+static node_t* mut(op_t * const op, node_t ** const link)
+{
+    node_t* node = *link;
+    if (node == NULL || op->failed || (node->flags & NODE_FRESH)) return node;
+
+    if (!CHECK(ERROR, op->fresh_amount < OP_MAX_NODES, "ctree: update touched too many nodes"))
+    {
+        op->failed = true;
+        return node;
+    }
+
+    node_t* copy = (node_t*)slab_record_alloc(&op->tree->tree.slab, op->tree->tree.allocator);
+    if (!CHECK(ERROR, copy != NULL, "ctree: node copy alloc failed"))
+    {
+        op->failed = true;
+        return node;
+    }
+
+    memcpy(copy, node, sizeof(*copy));
+    copy->flags |= NODE_FRESH;
+    op->fresh[op->fresh_amount++] = copy;
+
+    retire(op, node, 0);
+    *link = copy;
+    return copy;
+}
+
+static void rotate_left(op_t * const op, node_t ** const link)
+{
+    node_t* x = mut(op, link);
+    node_t* y = mut(op, &x->right);
+    if (op->failed) return;
+
+    x->right = y->left;
+    y->left  = x;
+    update(x);
+    update(y);
+    *link = y;
+}
+
+static void rotate_right(op_t * const op, node_t ** const link)
+{
+    node_t* x = mut(op, link);
+    node_t* y = mut(op, &x->left);
+    if (op->failed) return;
+
+    x->left  = y->right;
+    y->right = x;
+    update(x);
+    update(y);
+    *link = y;
+}
+
+static void rebalance_path(op_t * const op, node_t** path[], size_t depth)
+{
+    while (depth-- > 0 && !op->failed)
+    {
+        node_t** link = path[depth];
+        node_t*  node = mut(op, link);
+        if (op->failed) return;
+
+        const int old_height = node->height;
+        update(node);
+
+        const int balance = height_of(node->left) - height_of(node->right);
+        if (balance > 1)
+        {
+            if (height_of(node->left->left) < height_of(node->left->right))
+                rotate_left(op, &node->left);
+            rotate_right(op, link);
+        }
+        else if (balance < -1)
+        {
+            if (height_of(node->right->right) < height_of(node->right->left))
+                rotate_right(op, &node->right);
+            rotate_left(op, link);
+        }
+
+        if ((*link)->height == old_height) break;
+    }
+}
+
+static err_t limbo_push(ctree_t * const tree, ctree_limbo_t * const limbo,
+                        const ctree_retired_t * const items, const size_t amount)
+{
+    if (amount == 0) return OK;
+
+    if (limbo->amount + amount > limbo->capacity)
+    {
+        size_t capacity = limbo->capacity ? limbo->capacity : 256;
+        while (capacity < limbo->amount + amount) capacity *= 2;
+
+        ctree_retired_t* grown = (ctree_retired_t*)mem_realloc(tree->tree.allocator, limbo->items,
+                                                               limbo->capacity * sizeof(ctree_retired_t),
+                                                               capacity * sizeof(ctree_retired_t));
+        if (!CHECK(ERROR, grown != NULL, "ctree: limbo alloc failed (%zu)", capacity))
+            return ERR_ALLOC;
+
+        limbo->items    = grown;
+        limbo->capacity = capacity;
+    }
+
+    memcpy(&limbo->items[limbo->amount], items, amount * sizeof(ctree_retired_t));
+    limbo->amount += amount;
+    return OK;
+}
+
+static void limbo_reclaim(ctree_t * const tree, ctree_limbo_t * const limbo)
+{
+    for (size_t i = 0; i < limbo->amount; ++i)
+    {
+        const ctree_retired_t* r = &limbo->items[i];
+        if (r->size == 0) slab_record_free(&tree->tree.slab, r->ptr);
+        else              slab_bytes_free (&tree->tree.slab, r->ptr, r->size);
+    }
+    limbo->amount = 0;
+}
+
+// Advance the epoch once every active reader has observed the current one
+static void try_advance(ctree_t * const tree)
+{
+    const uint64_t epoch = atomic_load(&tree->epoch);
+
+    for (size_t i = 0; i < CTREE_MAX_READERS; ++i)
+    {
+        const uint64_t state = atomic_load(&tree->slots[i].state);
+        if ((state & CTREE_ACTIVE) && (state >> 1) != epoch) return;
+    }
+
+    atomic_store(&tree->epoch, epoch + 1);
+    // Retired two epochs ago: no reader can still hold those nodes
+    limbo_reclaim(tree, &tree->limbo[(epoch + 1) % 3]);
+}
+
+// Nothing was published: every node copied for the update and the new leaf go back
+static void rollback(op_t * const op)
+{
+    tree_t* tree = &op->tree->tree;
+
+    node_t* leaf = op->leaf;
+    if (leaf != NULL)
+    {
+        TREE_STAT(tree, key_bytes, 0 - leaf->key.len);
+        if (!leaf->is_inline && leaf->data.heap)
+        {
+            TREE_STAT(tree, heap_key_bytes, 0 - (leaf->key.len + 1));
+            slab_bytes_free(&tree->slab, leaf->data.heap, leaf->key.len + 1);
+        }
+    }
+
+    for (size_t i = 0; i < op->fresh_amount; ++i)
+        slab_record_free(&tree->slab, op->fresh[i]);
+}
+
+// Publish the new root or roll back every node copied for the update
+static err_t finish(op_t * const op, node_t * const root, const err_t status)
+{
+    ctree_t* tree = op->tree;
+
+    if (op->failed || status != OK)
+    {
+        rollback(op);
+        return op->failed ? ERR_ALLOC : status;
+    }
+
+    const uint64_t epoch = atomic_load(&tree->epoch);
+    if (limbo_push(tree, &tree->limbo[epoch % 3], op->retired, op->retired_amount) != OK)
+    {
+        rollback(op);
+        return ERR_ALLOC;
+    }
+
+    for (size_t i = 0; i < op->fresh_amount; ++i)
+        op->fresh[i]->flags &= (uint8_t)~NODE_FRESH;
+
+    atomic_store_explicit(&tree->root, root, memory_order_release);
+    try_advance(tree);
+    return OK;
+}
+
+err_t ctree_ctor(ctree_t * const tree, const allocator_t * const allocator)
+{
+    if (!CHECK(ERROR, tree != NULL, "ctree_ctor: tree is NULL"))
+        return ERR_BAD_ARG;
+
+    memset(tree, 0, sizeof(*tree));
+    const err_t rc = tree_ctor_alloc(&tree->tree, allocator);
+    if (rc != OK) return rc;
+
+    atomic_init(&tree->root,  NULL);
+    atomic_init(&tree->epoch, 0);
+    for (size_t i = 0; i < CTREE_MAX_READERS; ++i)
+    {
+        atomic_init(&tree->slots[i].state, 0);
+        atomic_init(&tree->slots[i].used,  false);
+    }
+
+    pthread_mutex_init(&tree->writer, NULL);
+    return OK;
+}
+
+err_t ctree_dtor(ctree_t * const tree)
+{
+    if (!CHECK(ERROR, tree != NULL, "ctree_dtor: tree is NULL"))
+        return ERR_BAD_ARG;
+
+    for (size_t i = 0; i < 3; ++i)
+    {
+        mem_free(tree->tree.allocator, tree->limbo[i].items,
+                 tree->limbo[i].capacity * sizeof(ctree_retired_t));
+        tree->limbo[i] = (ctree_limbo_t){ 0 };
+    }
+
+    atomic_store(&tree->root, NULL);
+    pthread_mutex_destroy(&tree->writer);
+    return tree_dtor(&tree->tree);
+}
+
+err_t ctree_insert(ctree_t * const tree, const char * const data)
+{
+    if (!CHECK(ERROR, tree != NULL, "ctree_insert: tree is NULL"))
+        return ERR_BAD_ARG;
+
+    tree_key_t key;
+    tree_key_parse(data, &key);
+
+    pthread_mutex_lock(&tree->writer);
+
+    op_t op;
+    op.tree           = tree;
+    op.fresh_amount   = 0;
+    op.retired_amount = 0;
+    op.leaf           = NULL;
+    op.failed         = false;
+
+    node_t*  root  = atomic_load_explicit(&tree->root, memory_order_relaxed);
+    node_t** path[TREE_MAX_HEIGHT + 1];
+    size_t   depth = 0;
+    node_t** link  = &root;
+    err_t    rc    = OK;
+
+    while (*link != NULL && !op.failed)
+    {
+        if (!CHECK(ERROR, depth < TREE_MAX_HEIGHT, "ctree_insert: descent exceeded limit"))
+        {
+            rc = ERR_CORRUPT;
+            break;
+        }
+
+        node_t* node = mut(&op, link);
+        path[depth++] = link;
+        link = (tree_key_compare(&node->key, node_data(node), &key, data) > 0) ? &node->left : &node->right;
+    }
+
+    if (rc == OK && !op.failed)
+    {
+        node_t* node = tree_node_new(&tree->tree, data, &key);
+        if (node == NULL) {
+            op.failed = true;
+        } else {
+            node->flags |= NODE_FRESH;
+            op.fresh[op.fresh_amount++] = node;
+            op.leaf = node;
+            *link = node;
+            rebalance_path(&op, path, depth);
+        }
+    }
+
+    rc = finish(&op, root, rc);
+    if (rc == OK)
+    {
+        tree->tree.nodes_amount += 1;
+        TREE_STAT(&tree->tree, inserts, 1);
+    }
+
+    pthread_mutex_unlock(&tree->writer);
+    return rc;
+}
+
+err_t ctree_delete(ctree_t * const tree, const char * const key)
+{
+    if (!CHECK(ERROR, tree != NULL, "ctree_delete: tree is NULL"))
+        return ERR_BAD_ARG;
+
+    tree_key_t k;
+    tree_key_parse(key, &k);
+
+    pthread_mutex_lock(&tree->writer);
+
+    // Find the target first so that a miss copies nothing
+    const node_t* probe = atomic_load_explicit(&tree->root, memory_order_relaxed);
+    while (probe != NULL)
+    {
+        const int cmp = tree_key_compare(&k, key, &probe->key, node_data(probe));
+        if (cmp == 0) break;
+        probe = (cmp < 0) ? probe->left : probe->right;
+    }
+
+    if (probe == NULL)
+    {
+        pthread_mutex_unlock(&tree->writer);
+        return ERR_NOT_FOUND;
+    }
+
+    op_t op;
+    op.tree           = tree;
+    op.fresh_amount   = 0;
+    op.retired_amount = 0;
+    op.leaf           = NULL;
+    op.failed         = false;
+
+    node_t*  root  = atomic_load_explicit(&tree->root, memory_order_relaxed);
+    node_t** path[TREE_MAX_HEIGHT + 1];
+    size_t   depth = 0;
+    node_t** link  = &root;
+
+    while (!op.failed)
+    {
+        const int cmp = tree_key_compare(&k, key, &(*link)->key, node_data(*link));
+        if (cmp == 0) break;
+
+        node_t* node = mut(&op, link);
+        path[depth++] = link;
+        link = (cmp < 0) ? &node->left : &node->right;
+    }
+
+    // target itself is never copied, it leaves the tree as it is
+    node_t* target = *link;
+    if (!op.failed)
+    {
+        if (target->right == NULL)
+        {
+            *link = target->left;
+        } else {
+            path[depth++] = link;
+            const size_t below = depth;
+
+            node_t*  right     = target->right;
+            node_t** succ_link = &right;
+            while (!op.failed && (*succ_link)->left != NULL)
+            {
+                node_t* node = mut(&op, succ_link);
+                path[depth++] = succ_link;
+                succ_link = &node->left;
+            }
+
+            node_t* succ = mut(&op, succ_link);
+            if (!op.failed)
+            {
+                *succ_link   = succ->right;
+                succ->left   = target->left;
+                succ->right  = right;
+                succ->height = target->height;
+                *link        = succ;
+                if (depth > below) path[below] = &succ->right;
+            }
+        }
+
+        if (!op.failed)
+        {
+            if (!target->is_inline && target->data.heap)
+                retire(&op, target->data.heap, target->key.len + 1);
+            retire(&op, target, 0);
+            rebalance_path(&op, path, depth);
+        }
+    }
+
+    const err_t rc = finish(&op, root, OK);
+    if (rc == OK)
+    {
+        tree->tree.nodes_amount -= 1;
+        TREE_STAT(&tree->tree, deletes, 1);
+        TREE_STAT(&tree->tree, key_bytes, 0 - target->key.len);
+        if (!target->is_inline && target->data.heap)
+            TREE_STAT(&tree->tree, heap_key_bytes, 0 - (target->key.len + 1));
+    }
+
+    pthread_mutex_unlock(&tree->writer);
+    return rc;
+}
+
+err_t ctree_reader_register(ctree_t * const tree, ctree_reader_t * const reader)
+{
+    if (!CHECK(ERROR, tree != NULL && reader != NULL, "ctree_reader_register: bad args"))
+        return ERR_BAD_ARG;
+
+    for (size_t i = 0; i < CTREE_MAX_READERS; ++i)
+    {
+        bool expected = false;
+        if (atomic_compare_exchange_strong(&tree->slots[i].used, &expected, true))
+        {
+            reader->tree = tree;
+            reader->slot = i;
+            return OK;
+        }
+    }
+
+    log_printf(ERROR, "ctree_reader_register: all %d slots are taken", CTREE_MAX_READERS);
+    return ERR_ALLOC;
+}
+
+void ctree_reader_unregister(ctree_reader_t * const reader)
+{
+    if (reader == NULL || reader->tree == NULL) return;
+
+    atomic_store(&reader->tree->slots[reader->slot].state, 0);
+    atomic_store(&reader->tree->slots[reader->slot].used,  false);
+    reader->tree = NULL;
+}
+
+void ctree_read_lock(const ctree_reader_t * const reader)
+{
+    ctree_t* tree = reader->tree;
+    const uint64_t epoch = atomic_load(&tree->epoch);
+
+    atomic_store(&tree->slots[reader->slot].state, (epoch << 1) | CTREE_ACTIVE);
+    // The slot must be visible before any node of the tree is read
+    atomic_thread_fence(memory_order_seq_cst);
+}
+
+void ctree_read_unlock(const ctree_reader_t * const reader)
+{
+    atomic_store_explicit(&reader->tree->slots[reader->slot].state, 0, memory_order_release);
+}
+
+err_t ctree_find(const ctree_t * const tree, const char * const key, const node_t ** const found)
+{
+    if (!CHECK(ERROR, tree != NULL && found != NULL, "ctree_find: bad args"))
+        return ERR_BAD_ARG;
+
+    tree_key_t k;
+    tree_key_parse(key, &k);
+
+    const node_t* cur = atomic_load_explicit(&((ctree_t*)tree)->root, memory_order_acquire);
+    while (cur != NULL)
+    {
+        const int cmp = tree_key_compare(&k, key, &cur->key, node_data(cur));
+        if (cmp == 0) break;
+        cur = (cmp < 0) ? cur->left : cur->right;
+    }
+
+    *found = cur;
+    return cur ? OK : ERR_NOT_FOUND;
+}
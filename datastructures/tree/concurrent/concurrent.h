@@ -0,0 +1,82 @@
+#ifndef TCONCURRENT_H
+#define TCONCURRENT_H
+
+#include "../tree.h"
+#include "../../../libs/logging/logging.h"
+#include "../../../libs/alloc/alloc.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#define CTREE_MAX_READERS 128
+
+// Reader slot state: epoch << 1 | CTREE_ACTIVE while inside a read section
+#define CTREE_ACTIVE 0x1
+
+typedef struct
+{
+    _Atomic uint64_t state;
+    atomic_bool      used;
+    char             pad[64 - sizeof(uint64_t) - sizeof(atomic_bool)];
+} ctree_slot_t;
+
+// Retired block: a node record when size is 0, key bytes otherwise
+typedef struct
+{
+    void*  ptr;
+    size_t size;
+} ctree_retired_t;
+
+typedef struct
+{
+    ctree_retired_t* items;
+    size_t           amount;
+    size_t           capacity;
+} ctree_limbo_t;
+
+/*
+    Tree readable by many threads while writers (serialized by a mutex)
+    update it by path copying: published nodes are never modified, the new
+    root is stored atomically and replaced nodes wait in the limbo of their
+    epoch until every active reader has moved past it. tree holds the
+    writer-owned slab and counters, its root field is unused
+*/
+typedef struct
+{
+    _Atomic(node_t*) root;
+    tree_t           tree;
+
+    pthread_mutex_t  writer;
+    _Atomic uint64_t epoch;
+    ctree_limbo_t    limbo[3];
+
+    ctree_slot_t     slots[CTREE_MAX_READERS];
+} ctree_t;
+
+typedef struct
+{
+    ctree_t* tree;
+    size_t   slot;
+} ctree_reader_t;
+
+err_t ctree_ctor(ctree_t * const tree, const allocator_t * const allocator);
+err_t ctree_dtor(ctree_t * const tree);
+
+err_t ctree_insert(ctree_t * const tree, const char * const data);
+err_t ctree_delete(ctree_t * const tree, const char * const key);
+
+err_t ctree_reader_register  (ctree_t * const tree, ctree_reader_t * const reader);
+void  ctree_reader_unregister(ctree_reader_t * const reader);
+
+/*
+    Nodes returned by ctree_find stay valid until the matching unlock
+*/
+void  ctree_read_lock  (const ctree_reader_t * const reader);
+void  ctree_read_unlock(const ctree_reader_t * const reader);
+
+err_t ctree_find(const ctree_t * const tree, const char * const key, const node_t ** const found);
+
+#endif
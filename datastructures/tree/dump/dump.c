@@ -24,13 +24,18 @@ static size_t find_index_by_ptr(NodeInfo *arr, size_t n, const node_t *p)
     return (size_t)-1;
 }
 
-static void assign_inorder_xpos(const node_t *node, NodeInfo *arr, size_t n, size_t *counter)
+static void assign_inorder_xpos(const tree_t *tree, NodeInfo *arr, size_t n)
 {
-    if (!node) return;
-    assign_inorder_xpos(node->left,  arr, n, counter);
-    size_t idx = find_index_by_ptr(arr, n, node);
-    if (idx != (size_t)-1) arr[idx].xpos = (*counter)++;
-    assign_inorder_xpos(node->right, arr, n, counter);
+    tree_iter_t it;
+    (void)tree_iter_begin(&it, tree, TREE_INORDER);
+
+    size_t counter = 0;
+    const node_t *node = NULL;
+    while ((node = tree_iter_next(&it)) != NULL) {
+        size_t idx = find_index_by_ptr(arr, n, node);
+        if (idx != (size_t)-1) arr[idx].xpos = counter++;
+    }
+    tree_iter_end(&it);
 }
 
 void tree_dump(const tree_t *tree, const char *title, const char *html_file)
@@ -87,41 +92,38 @@ void tree_dump(const tree_t *tree, const char *title, const char *html_file)
         return;
     }
 
-    size_t cap  = 64;
-    size_t n    = 0;
-    size_t head = 0;
-    size_t tail = 0;
-    NodeInfo *nodes = (NodeInfo*)calloc(cap, sizeof(NodeInfo));
-    const node_t **q_nodes = (const node_t**)calloc(cap, sizeof(node_t*));
-    if (!nodes || !q_nodes) 
-        { free(nodes); free(q_nodes); fclose(dot); return; }
+    const allocator_t* a = tree->allocator;
 
-    q_nodes[tail++] = root;
+    size_t cap = 64;
+    size_t n   = 0;
+    NodeInfo *nodes = (NodeInfo*)mem_calloc(a, cap, sizeof(NodeInfo));
+    if (!nodes) { fclose(dot); return; }
 
-    while (head < tail) {
-        const node_t *cur = q_nodes[head++];
+    tree_iter_t it;
+    (void)tree_iter_begin(&it, tree, TREE_LEVELORDER);
 
+    const node_t *cur = NULL;
+    while ((cur = tree_iter_next(&it)) != NULL) {
         if (n == cap) {
-            cap *= 2;
-            nodes    = (NodeInfo*)realloc(nodes, cap * sizeof(NodeInfo));
-            q_nodes  = (const node_t**)realloc(q_nodes, cap * sizeof(node_t*));
-            if (!nodes || !q_nodes) 
-                { free(nodes); free(q_nodes); fclose(dot); return; }
+            NodeInfo *nnodes = (NodeInfo*)mem_realloc(a, nodes, cap * sizeof(NodeInfo),
+                                                      2 * cap * sizeof(NodeInfo));
+            if (!nnodes) {
+                tree_iter_end(&it);
+                mem_free(a, nodes, cap * sizeof(NodeInfo));
+                fclose(dot); return;
+            }
+            nodes = nnodes;
+            cap  *= 2;
         }
 
         nodes[n].node  = cur;
         nodes[n].id    = n;
         nodes[n].xpos  = 0;
         n++;
-
-        if (cur->left)  q_nodes[tail++] = cur->left;
-        if (cur->right) q_nodes[tail++] = cur->right;
     }
+    tree_iter_end(&it);
 
-    free(q_nodes);
-
-    size_t counter = 0;
-    assign_inorder_xpos(root, nodes, n, &counter);
+    assign_inorder_xpos(tree, nodes, n);
 
     for (size_t i = 0; i < n; ++i) {
         const node_t *p = nodes[i].node;
@@ -139,7 +141,7 @@ void tree_dump(const tree_t *tree, const char *title, const char *html_file)
             "</TABLE>"
             ">];\n",
             nodes[i].id, outline, fill, TABLE_BRD, CELL_BG, TXT_COLOR,
-            (void*)p, (char*)p->data, (void*)p->left, (void*)p->right);
+            (void*)p, node_data(p), (void*)p->left, (void*)p->right);
     }
 
     for (size_t i = 0; i < n; ++i) {
@@ -175,6 +177,6 @@ void tree_dump(const tree_t *tree, const char *title, const char *html_file)
         fclose(html);
     }
 
-    free(nodes);
+    mem_free(a, nodes, cap * sizeof(NodeInfo));
 }
 
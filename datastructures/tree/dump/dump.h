@@ -2,6 +2,7 @@
 #define TDUMP_H
 
 #include "../tree.h"
+#include "../iter/iter.h"
 #include "../../../libs/logging/logging.h"
 
 #include <stdio.h>
@@ -0,0 +1,188 @@
+#include "frozen.h"
+
+#if defined(__GNUC__)
+#define PREFETCH(ptr) __builtin_prefetch((ptr), 0, 3)
+#else
+#define PREFETCH(ptr) ((void)(ptr))
+#endif
+
+// Slots 16k..16k+15 hold the 4th level below slot k, 4 cache lines
+#define FROZEN_LOOKAHEAD 16
+#define FROZEN_PER_LINE  (FROZEN_LINE / sizeof(frozen_key_t))
+
+static void free_arrays(tree_frozen_t * const frozen)
+{
+    const allocator_t* a = frozen->allocator;
+    const size_t slots = frozen->size + 1;
+
+    mem_free(a, frozen->keys_block, slots * sizeof(frozen_key_t) + FROZEN_LINE);
+    mem_free(a, frozen->lens,       slots * sizeof(size_t));
+    mem_free(a, (void*)frozen->strs, slots * sizeof(char*));
+    mem_free(a, frozen->pool,       frozen->pool_size);
+}
+
+// In-order successor of slot k in the implicit complete tree of n slots
+static inline size_t next_inorder(size_t k, const size_t n)
+{
+    if (2 * k + 1 <= n)
+    {
+        k = 2 * k + 1;
+        while (2 * k <= n) k *= 2;
+        return k;
+    }
+    while (k & 1) k >>= 1;
+    return k >> 1;
+}
+
+err_t tree_freeze(const tree_t * const tree, tree_frozen_t * const frozen)
+{
+    if (!CHECK(ERROR, tree != NULL && frozen != NULL, "tree_freeze: bad args"))
+        return ERR_BAD_ARG;
+
+    *frozen = (tree_frozen_t){ 0 };
+    frozen->allocator = tree->allocator;
+    frozen->size      = tree->nodes_amount;
+
+    const allocator_t* a = tree->allocator;
+    const size_t slots = frozen->size + 1;
+
+    tree_iter_t it;
+    (void)tree_iter_begin(&it, tree, TREE_INORDER);
+    const node_t* node = NULL;
+    while ((node = tree_iter_next(&it)) != NULL)
+        if (node_data(node)) frozen->pool_size += node->key.len + 1;
+    tree_iter_end(&it);
+
+    frozen->keys_block = mem_alloc(a, slots * sizeof(frozen_key_t) + FROZEN_LINE);
+    frozen->lens       = (size_t*)mem_calloc(a, slots, sizeof(size_t));
+    frozen->strs       = (const char**)mem_calloc(a, slots, sizeof(char*));
+    frozen->pool       = frozen->pool_size ? (char*)mem_alloc(a, frozen->pool_size) : NULL;
+
+    if (!CHECK(ERROR, frozen->keys_block && frozen->lens && frozen->strs &&
+                      (frozen->pool || !frozen->pool_size),
+               "tree_freeze: alloc failed (%zu keys)", frozen->size))
+    {
+        free_arrays(frozen);
+        *frozen = (tree_frozen_t){ 0 };
+        return ERR_ALLOC;
+    }
+
+    const uintptr_t base = (uintptr_t)frozen->keys_block;
+    frozen->keys = (frozen_key_t*)((base + FROZEN_LINE - 1) & ~(uintptr_t)(FROZEN_LINE - 1));
+    frozen->keys[0] = (frozen_key_t){ 0 };
+
+    // Walk the tree and the implicit layout in order side by side
+    size_t k = 1;
+    while (2 * k <= frozen->size) k *= 2;
+
+    char* pool = frozen->pool;
+    (void)tree_iter_begin(&it, tree, TREE_INORDER);
+    while ((node = tree_iter_next(&it)) != NULL && k != 0)
+    {
+        frozen->keys[k] = (frozen_key_t){ node->key.num, node->key.prefix };
+        frozen->lens[k] = node->key.len;
+
+        const char* data = node_data(node);
+        if (data != NULL)
+        {
+            memcpy(pool, data, node->key.len + 1);
+            frozen->strs[k] = pool;
+            pool += node->key.len + 1;
+        }
+        k = next_inorder(k, frozen->size);
+    }
+    const err_t status = it.status;
+    tree_iter_end(&it);
+
+    if (status != OK)
+    {
+        free_arrays(frozen);
+        *frozen = (tree_frozen_t){ 0 };
+        return status;
+    }
+    return OK;
+}
+
+err_t tree_frozen_dtor(tree_frozen_t * const frozen)
+{
+    if (!CHECK(ERROR, frozen != NULL, "tree_frozen_dtor: frozen is NULL"))
+        return ERR_BAD_ARG;
+
+    free_arrays(frozen);
+    *frozen = (tree_frozen_t){ 0 };
+    return OK;
+}
+
+static inline int slot_less(const tree_frozen_t * const frozen, const size_t k,
+                            const tree_key_t * const key, const char * const str)
+{
+    const frozen_key_t* s = &frozen->keys[k];
+    const int num_less = s->num < key->num;
+    const int num_eq   = s->num == key->num;
+    const int pre_less = s->prefix < key->prefix;
+    const int pre_eq   = s->prefix == key->prefix;
+
+    int less = num_less | (num_eq & pre_less);
+    // A query shorter than the prefix that ties on it is the same string
+    if ((num_eq & pre_eq) && key->len >= sizeof(s->prefix))
+    {
+        const tree_key_t slot_key = { s->num, s->prefix, frozen->lens[k] };
+        less = tree_key_compare(&slot_key, frozen->strs[k], key, str) < 0;
+    }
+    return less;
+}
+
+static size_t lower_bound_slot(const tree_frozen_t * const frozen,
+                               const tree_key_t * const key, const char * const str)
+{
+    const size_t n = frozen->size;
+
+    size_t k = 1;
+    while (k <= n)
+    {
+        const frozen_key_t* ahead = frozen->keys + FROZEN_LOOKAHEAD * k;
+        for (size_t line = 0; line < FROZEN_LOOKAHEAD; line += FROZEN_PER_LINE)
+            PREFETCH(ahead + line);
+        k = 2 * k + (size_t)slot_less(frozen, k, key, str);
+    }
+
+    // Drop the trailing right turns plus the last left one
+    k >>= __builtin_ctzll(~(unsigned long long)k) + 1;
+    return k;
+}
+
+err_t tree_frozen_lower_bound(const tree_frozen_t * const frozen, const char * const key,
+                              size_t * const slot)
+{
+    if (!CHECK(ERROR, frozen != NULL && slot != NULL, "tree_frozen_lower_bound: bad args"))
+        return ERR_BAD_ARG;
+
+    tree_key_t k;
+    tree_key_parse(key, &k);
+
+    *slot = lower_bound_slot(frozen, &k, key);
+    return *slot ? OK : ERR_NOT_FOUND;
+}
+
+err_t tree_frozen_find(const tree_frozen_t * const frozen, const char * const key,
+                       size_t * const slot)
+{
+    if (!CHECK(ERROR, frozen != NULL && slot != NULL, "tree_frozen_find: bad args"))
+        return ERR_BAD_ARG;
+
+    tree_key_t k;
+    tree_key_parse(key, &k);
+
+    size_t s = lower_bound_slot(frozen, &k, key);
+    if (s != 0 && (frozen->keys[s].num != k.num || frozen->keys[s].prefix != k.prefix))
+        s = 0;
+
+    if (s != 0 && k.len >= sizeof(k.prefix))
+    {
+        const tree_key_t found = { frozen->keys[s].num, frozen->keys[s].prefix, frozen->lens[s] };
+        if (tree_key_compare(&found, frozen->strs[s], &k, key) != 0) s = 0;
+    }
+
+    *slot = s;
+    return s ? OK : ERR_NOT_FOUND;
+}
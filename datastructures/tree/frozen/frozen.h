@@ -0,0 +1,56 @@
+#ifndef TFROZEN_H
+#define TFROZEN_H
+
+#include "../tree.h"
+#include "../iter/iter.h"
+#include "../../../libs/logging/logging.h"
+#include "../../../libs/alloc/alloc.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define FROZEN_LINE 64
+
+// Hot half of a key, four per cache line
+typedef struct
+{
+    int64_t  num;
+    uint64_t prefix;
+} frozen_key_t;
+
+/*
+    Immutable copy of a tree in Eytzinger (BFS) order: slot k has children
+    2k and 2k + 1, slot 0 is unused. Searches only touch the hot keys array
+    and fall back to lens/strs on ties of long keys. Key bytes live in one pool
+*/
+typedef struct
+{
+    size_t              size;
+
+    frozen_key_t*       keys;
+    size_t*             lens;
+    const char**        strs;
+    char*               pool;
+
+    size_t              pool_size;
+    void*               keys_block;
+    const allocator_t*  allocator;
+} tree_frozen_t;
+
+err_t tree_freeze      (const tree_t * const tree, tree_frozen_t * const frozen);
+err_t tree_frozen_dtor (tree_frozen_t * const frozen);
+
+/*
+    Slot of the first key not less than key / equal to key, 0 when there is none
+*/
+err_t tree_frozen_lower_bound(const tree_frozen_t * const frozen, const char * const key,
+                              size_t * const slot);
+err_t tree_frozen_find       (const tree_frozen_t * const frozen, const char * const key,
+                              size_t * const slot);
+
+static inline const char* tree_frozen_key(const tree_frozen_t * const frozen, const size_t slot)
+{
+    return (slot >= 1 && slot <= frozen->size) ? frozen->strs[slot] : NULL;
+}
+
+#endif
@@ -0,0 +1,247 @@
+#include "iter.h"
+
+err_t tree_iter_begin(tree_iter_t * const it, const tree_t * const tree,
+                      const tree_order_t order)
+{
+    if (!CHECK(ERROR, tree != NULL, "tree_iter_begin: tree is NULL"))
+        return ERR_BAD_ARG;
+
+    return tree_iter_begin_node(it, tree->root, tree->allocator, order);
+}
+
+err_t tree_iter_begin_node(tree_iter_t * const it, node_t * const root,
+                           const allocator_t * const allocator, const tree_order_t order)
+{
+    if (!CHECK(ERROR, it != NULL, "tree_iter_begin_node: iterator is NULL"))
+        return ERR_BAD_ARG;
+
+    if (!CHECK(ERROR, order == TREE_LEVELORDER || (order > 0 && order <= TREE_EULER),
+               "tree_iter_begin_node: bad order %d", (int)order))
+        return ERR_BAD_ARG;
+
+    it->order     = order;
+    it->visit     = 0;
+    it->depth     = 0;
+    it->status    = OK;
+    it->allocator = allocator;
+    it->frames    = it->inline_frames;
+    it->head      = 0;
+    it->amount    = 0;
+    it->capacity  = sizeof(it->inline_frames) / sizeof(it->inline_frames[0]);
+
+    if (root != NULL)
+    {
+        it->frames[0] = (tree_iter_frame_t){ root, (order == TREE_LEVELORDER) ? 0 : TREE_PREORDER };
+        it->amount    = 1;
+    }
+    return OK;
+}
+
+static err_t iter_reserve(tree_iter_t * const it)
+{
+    if (it->amount < it->capacity) return OK;
+
+    const size_t new_capacity = it->capacity * 2;
+    tree_iter_frame_t* frames =
+        (tree_iter_frame_t*)mem_calloc(it->allocator, new_capacity, sizeof(*frames));
+    if (!CHECK(ERROR, frames != NULL, "tree_iter: frame alloc failed (%zu)", new_capacity))
+        return ERR_ALLOC;
+
+    // Unroll the ring so that level order keeps FIFO from index 0
+    for (size_t i = 0; i < it->amount; ++i)
+        frames[i] = it->frames[(it->head + i) % it->capacity];
+
+    if (it->frames != it->inline_frames)
+        mem_free(it->allocator, it->frames, it->capacity * sizeof(*it->frames));
+
+    it->frames   = frames;
+    it->head     = 0;
+    it->capacity = new_capacity;
+    return OK;
+}
+
+static node_t* fail(tree_iter_t * const it, const err_t err)
+{
+    it->status = err;
+    it->amount = 0;
+    return NULL;
+}
+
+static node_t* next_level(tree_iter_t * const it)
+{
+    if (it->amount == 0) return NULL;
+
+    const tree_iter_frame_t f = it->frames[it->head];
+    it->head    = (it->head + 1) % it->capacity;
+    it->amount -= 1;
+
+    node_t* children[2] = { f.node->left, f.node->right };
+    for (int i = 0; i < 2; ++i)
+    {
+        if (children[i] == NULL) continue;
+        if (iter_reserve(it) != OK) return fail(it, ERR_ALLOC);
+
+        it->frames[(it->head + it->amount) % it->capacity] =
+            (tree_iter_frame_t){ children[i], f.state + 1 };
+        it->amount += 1;
+    }
+
+    it->visit = TREE_LEVELORDER;
+    it->depth = (size_t)f.state;
+    return f.node;
+}
+
+static node_t* next_depth(tree_iter_t * const it)
+{
+    while (it->amount > 0)
+    {
+        const size_t       top   = it->amount - 1;
+        node_t*            node  = it->frames[top].node;
+        const int          state = it->frames[top].state;
+        node_t*            child = NULL;
+
+        if (state == TREE_PREORDER)
+        {
+            it->frames[top].state = TREE_INORDER;
+            child = node->left;
+        }
+        else if (state == TREE_INORDER)
+        {
+            it->frames[top].state = TREE_POSTORDER;
+            child = node->right;
+        }
+        else
+        {
+            it->amount -= 1;
+        }
+
+        if (child != NULL)
+        {
+            if (iter_reserve(it) != OK) return fail(it, ERR_ALLOC);
+            it->frames[it->amount++] = (tree_iter_frame_t){ child, TREE_PREORDER };
+        }
+
+        if (it->order & state)
+        {
+            it->visit = state;
+            it->depth = top;
+            return node;
+        }
+    }
+    return NULL;
+}
+
+node_t* tree_iter_next(tree_iter_t * const it)
+{
+    if (it == NULL || it->status != OK) return NULL;
+
+    return (it->order == TREE_LEVELORDER) ? next_level(it) : next_depth(it);
+}
+
+void tree_iter_end(tree_iter_t * const it)
+{
+    if (it == NULL) return;
+
+    if (it->frames != it->inline_frames)
+        mem_free(it->allocator, it->frames, it->capacity * sizeof(*it->frames));
+
+    it->frames   = it->inline_frames;
+    it->amount   = 0;
+    it->head     = 0;
+    it->capacity = sizeof(it->inline_frames) / sizeof(it->inline_frames[0]);
+}
+
+typedef struct
+{
+    const node_t* old;
+    node_t**      link;
+} relocate_frame_t;
+
+static err_t relocate(tslab_t * const slab, const allocator_t * const allocator,
+                      node_t * const dst, const node_t * const src)
+{
+    memcpy(dst, src, sizeof(*dst));
+    if (src->is_inline || src->data.heap == NULL) return OK;
+
+    char* copy = (char*)slab_bytes_alloc(slab, allocator, src->key.len + 1);
+    if (!CHECK(ERROR, copy != NULL, "tree_linearize: key alloc failed (%zu)", src->key.len + 1))
+        return ERR_ALLOC;
+
+    memcpy(copy, src->data.heap, src->key.len + 1);
+    dst->data.heap = copy;
+    return OK;
+}
+
+err_t tree_linearize(tree_t * const tree, const tree_order_t order)
+{
+    if (!CHECK(ERROR, tree != NULL, "tree_linearize: tree is NULL"))
+        return ERR_BAD_ARG;
+
+    if (!CHECK(ERROR, order == TREE_PREORDER || order == TREE_LEVELORDER,
+               "tree_linearize: bad order %d", (int)order))
+        return ERR_BAD_ARG;
+
+    if (tree->root == NULL) return OK;
+
+    const allocator_t* a = tree->allocator;
+    const size_t       n = tree->nodes_amount;
+
+    tslab_t slab;
+    slab_init(&slab, sizeof(node_t));
+
+    node_t* block = (node_t*)slab_carve(&slab, a, n * sizeof(node_t), sizeof(void*));
+    if (!CHECK(ERROR, block != NULL, "tree_linearize: node block alloc failed (%zu nodes)", n))
+        return ERR_ALLOC;
+
+    err_t   rc     = OK;
+    size_t  placed = 0;
+    node_t* root   = block;
+
+    if (order == TREE_LEVELORDER)
+    {
+        // The block is the queue: children of a placed node still point into the old tree
+        rc = relocate(&slab, a, &block[placed++], tree->root);
+        for (size_t k = 0; k < placed && rc == OK; ++k)
+        {
+            node_t** links[2] = { &block[k].left, &block[k].right };
+            for (size_t i = 0; i < 2 && rc == OK; ++i)
+            {
+                if (*links[i] == NULL) continue;
+                if (placed == n) { rc = ERR_CORRUPT; break; }
+
+                rc = relocate(&slab, a, &block[placed], *links[i]);
+                *links[i] = &block[placed++];
+            }
+        }
+    } else {
+        relocate_frame_t stack[TREE_MAX_HEIGHT + 2];
+        size_t top = 0;
+        stack[top++] = (relocate_frame_t){ tree->root, &root };
+
+        while (top > 0 && rc == OK)
+        {
+            const relocate_frame_t frame = stack[--top];
+            if (placed == n || top + 2 > TREE_MAX_HEIGHT + 2) { rc = ERR_CORRUPT; break; }
+
+            node_t* node = &block[placed++];
+            rc = relocate(&slab, a, node, frame.old);
+            *frame.link = node;
+
+            if (frame.old->right) stack[top++] = (relocate_frame_t){ frame.old->right, &node->right };
+            if (frame.old->left)  stack[top++] = (relocate_frame_t){ frame.old->left,  &node->left  };
+        }
+    }
+
+    if (rc == OK && placed != n) rc = ERR_CORRUPT;
+    if (!CHECK(ERROR, rc == OK, "tree_linearize: relocation failed (%d), %zu of %zu nodes placed",
+               (int)rc, placed, n))
+    {
+        slab_clear(&slab, a);
+        return rc;
+    }
+
+    slab_clear(&tree->slab, a);
+    tree->slab = slab;
+    tree->root = root;
+    return OK;
+}
@@ -0,0 +1,75 @@
+#ifndef TITER_H
+#define TITER_H
+
+#include "../tree.h"
+#include "../../../libs/logging/logging.h"
+#include "../../../libs/alloc/alloc.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+    Depth-first orders are bit masks over the three visits of a node,
+    TREE_EULER reports every node on entry, between subtrees and on exit
+*/
+typedef enum
+{
+    TREE_PREORDER   = 1,
+    TREE_INORDER    = 2,
+    TREE_POSTORDER  = 4,
+    TREE_EULER      = 7,
+    TREE_LEVELORDER = 8,
+} tree_order_t;
+
+typedef struct
+{
+    node_t* node;
+    int     state;
+} tree_iter_frame_t;
+
+/*
+    Explicit-stack traversal. Depth-first orders keep one frame per level,
+    level order keeps one ring slot per queued node. Frames start in the
+    inline buffer and spill to the allocator only past TREE_MAX_HEIGHT,
+    so the iterator must not be copied once started. In post order the
+    returned node is never touched again and may be freed by the caller
+*/
+typedef struct
+{
+    tree_order_t       order;
+    int                visit;
+    size_t             depth;
+    err_t              status;
+
+    const allocator_t* allocator;
+    tree_iter_frame_t* frames;
+    size_t             head;
+    size_t             amount;
+    size_t             capacity;
+
+    tree_iter_frame_t  inline_frames[TREE_MAX_HEIGHT + 1];
+} tree_iter_t;
+
+err_t   tree_iter_begin     (tree_iter_t * const it, const tree_t * const tree,
+                             const tree_order_t order);
+err_t   tree_iter_begin_node(tree_iter_t * const it, node_t * const root,
+                             const allocator_t * const allocator, const tree_order_t order);
+
+/*
+    Next node in order or NULL at the end (it->status tells ERR_ALLOC apart),
+    it->visit holds which visit (TREE_PREORDER/INORDER/POSTORDER) it was,
+    it->depth its distance from the root
+*/
+node_t* tree_iter_next(tree_iter_t * const it);
+
+void    tree_iter_end (tree_iter_t * const it);
+
+/*
+    Move every node into one block of a fresh slab in TREE_PREORDER or
+    TREE_LEVELORDER and long keys right after it, then drop the old slab.
+    Node pointers taken before the call are invalidated, the tree stays
+    mutable. On failure the tree is left as it was
+*/
+err_t   tree_linearize(tree_t * const tree, const tree_order_t order);
+
+#endif
@@ -0,0 +1,234 @@
+#include "parallel.h"
+
+// Per-worker accumulator, padded so workers don't share a cache line
+typedef struct
+{
+    int64_t value;
+    char    pad[64 - sizeof(int64_t)];
+} partial_t;
+
+typedef struct
+{
+    const allocator_t* allocator;
+    tree_map_t         map;
+    tree_reduce_t      reduce;
+    void*              ctx;
+    partial_t*         partials;
+    atomic_int         status;
+} reduce_ctx_t;
+
+typedef struct
+{
+    atomic_size_t seen;
+    atomic_int    status;
+} verify_ctx_t;
+
+static void set_status(atomic_int * const status, const err_t err)
+{
+    int expected = OK;
+    atomic_compare_exchange_strong(status, &expected, (int)err);
+}
+
+static void free_blocks_task(pool_worker_t * const self, void * const ctx, void * const arg[3])
+{
+    unused self;
+    const allocator_t* allocator = (const allocator_t*)ctx;
+
+    slab_block_t* block = (slab_block_t*)arg[0];
+    slab_block_t* last  = (slab_block_t*)arg[1];
+    while (block != last)
+    {
+        slab_block_t* next = block->next;
+        mem_free(allocator, block, block->size);
+        block = next;
+    }
+}
+
+static void free_blocks_root(pool_worker_t * const self, void * const ctx, void * const arg[3])
+{
+    // arg[0] is the chain, arg[2] the number of blocks in it
+    slab_block_t* block  = (slab_block_t*)arg[0];
+    const size_t  amount = (size_t)(uintptr_t)arg[2];
+    const size_t  chunk  = amount / self->pool->workers_amount + 1;
+
+    while (block != NULL)
+    {
+        slab_block_t* last = block;
+        for (size_t i = 0; i < chunk && last != NULL; ++i) last = last->next;
+
+        pool_spawn(self, free_blocks_task, ctx, block, last, NULL);
+        block = last;
+    }
+}
+
+err_t tree_par_clear(tree_t * const tree, pool_t * const pool)
+{
+    if (!CHECK(ERROR, tree != NULL && pool != NULL, "tree_par_clear: bad args"))
+        return ERR_BAD_ARG;
+
+    slab_block_t* blocks = tree->slab.blocks;
+    const size_t  amount = tree->slab.blocks_amount;
+
+    slab_init_aligned(&tree->slab, tree->slab.record_size, tree->slab.record_align);
+    tree->root         = NULL;
+    tree->nodes_amount = 0;
+
+    tree->counters.key_bytes      = 0;
+    tree->counters.heap_key_bytes = 0;
+
+    if (blocks == NULL) return OK;
+
+    // Without the pool the blocks still have to go, one thread is fine
+    if (pool_run(pool, free_blocks_root, (void*)tree->allocator,
+                 blocks, NULL, (void*)(uintptr_t)amount) != OK)
+        free_blocks_task(NULL, (void*)tree->allocator, (void*[3]){ blocks, NULL, NULL });
+    return OK;
+}
+
+static void reduce_task(pool_worker_t * const self, void * const ctx, void * const arg[3])
+{
+    reduce_ctx_t* rc   = (reduce_ctx_t*)ctx;
+    node_t*       node = (node_t*)arg[0];
+    int64_t*      acc  = &rc->partials[self->index].value;
+
+    if (node->height > TREE_PAR_CUTOFF)
+    {
+        *acc = rc->reduce(*acc, rc->map(node, rc->ctx));
+        if (node->left)  pool_spawn(self, reduce_task, ctx, node->left,  NULL, NULL);
+        if (node->right) pool_spawn(self, reduce_task, ctx, node->right, NULL, NULL);
+        return;
+    }
+
+    tree_iter_t it;
+    (void)tree_iter_begin_node(&it, node, rc->allocator, TREE_PREORDER);
+
+    const node_t* cur = NULL;
+    while ((cur = tree_iter_next(&it)) != NULL)
+        *acc = rc->reduce(*acc, rc->map(cur, rc->ctx));
+
+    if (it.status != OK) set_status(&rc->status, it.status);
+    tree_iter_end(&it);
+}
+
+err_t tree_par_map_reduce(const tree_t * const tree, pool_t * const pool,
+                          tree_map_t map, tree_reduce_t reduce, const int64_t identity,
+                          void * const ctx, int64_t * const result)
+{
+    if (!CHECK(ERROR, tree != NULL && pool != NULL && map != NULL && reduce != NULL &&
+                      result != NULL, "tree_par_map_reduce: bad args"))
+        return ERR_BAD_ARG;
+
+    *result = identity;
+    if (tree->root == NULL) return OK;
+
+    const size_t workers = pool->workers_amount;
+
+    reduce_ctx_t rc = { tree->allocator, map, reduce, ctx, NULL, 0 };
+    atomic_init(&rc.status, OK);
+
+    rc.partials = (partial_t*)mem_calloc(tree->allocator, workers, sizeof(partial_t));
+    if (!CHECK(ERROR, rc.partials != NULL, "tree_par_map_reduce: partials alloc failed"))
+        return ERR_ALLOC;
+    for (size_t i = 0; i < workers; ++i) rc.partials[i].value = identity;
+
+    err_t status = pool_run(pool, reduce_task, &rc, tree->root, NULL, NULL);
+    if (status == OK) status = (err_t)atomic_load(&rc.status);
+
+    for (size_t i = 0; i < workers; ++i)
+        *result = reduce(*result, rc.partials[i].value);
+
+    mem_free(tree->allocator, rc.partials, workers * sizeof(partial_t));
+    return status;
+}
+
+static inline int height_of(const node_t * const node)
+{
+    return node ? node->height : 0;
+}
+
+static bool verify_node(verify_ctx_t * const vc, const node_t * const node,
+                        const node_t * const lo, const node_t * const hi)
+{
+    const int hl = height_of(node->left);
+    const int hr = height_of(node->right);
+
+    if (!CHECK(ERROR, node->height == 1 + (hl > hr ? hl : hr) && hl - hr <= 1 && hr - hl <= 1,
+               "tree_par_verify: node %p height %d with children %d/%d",
+               (void*)node, node->height, hl, hr))
+        return false;
+
+    if (!CHECK(ERROR, (lo == NULL || tree_key_compare(&lo->key, node_data(lo), &node->key, node_data(node)) <= 0) &&
+                      (hi == NULL || tree_key_compare(&node->key, node_data(node), &hi->key, node_data(hi)) <= 0),
+               "tree_par_verify: node %p is out of order", (void*)node))
+        return false;
+
+    atomic_fetch_add_explicit(&vc->seen, 1, memory_order_relaxed);
+    return true;
+}
+
+static void verify_task(pool_worker_t * const self, void * const ctx, void * const arg[3])
+{
+    verify_ctx_t* vc   = (verify_ctx_t*)ctx;
+    node_t*       node = (node_t*)arg[0];
+    node_t*       lo   = (node_t*)arg[1];
+    node_t*       hi   = (node_t*)arg[2];
+
+    if (atomic_load_explicit(&vc->status, memory_order_relaxed) != OK) return;
+
+    if (node->height > TREE_PAR_CUTOFF)
+    {
+        if (!verify_node(vc, node, lo, hi)) { set_status(&vc->status, ERR_CORRUPT); return; }
+        if (node->left)  pool_spawn(self, verify_task, ctx, node->left,  lo,   node);
+        if (node->right) pool_spawn(self, verify_task, ctx, node->right, node, hi);
+        return;
+    }
+
+    // Below the cutoff heights are small, a fixed stack bounds a sane subtree
+    const node_t* stack[TREE_MAX_HEIGHT + 1][3];
+    size_t top = 0;
+    stack[top][0] = node; stack[top][1] = lo; stack[top][2] = hi; top++;
+
+    while (top > 0)
+    {
+        top -= 1;
+        const node_t* cur  = stack[top][0];
+        const node_t* clo  = stack[top][1];
+        const node_t* chi  = stack[top][2];
+
+        if (!verify_node(vc, cur, clo, chi)) { set_status(&vc->status, ERR_CORRUPT); return; }
+
+        if (!CHECK(ERROR, top + 2 <= TREE_MAX_HEIGHT, "tree_par_verify: subtree too deep"))
+        {
+            set_status(&vc->status, ERR_CORRUPT);
+            return;
+        }
+        if (cur->right) { stack[top][0] = cur->right; stack[top][1] = cur; stack[top][2] = chi; top++; }
+        if (cur->left)  { stack[top][0] = cur->left;  stack[top][1] = clo; stack[top][2] = cur; top++; }
+    }
+}
+
+err_t tree_par_verify(const tree_t * const tree, pool_t * const pool)
+{
+    if (!CHECK(ERROR, tree != NULL && pool != NULL, "tree_par_verify: bad args"))
+        return ERR_BAD_ARG;
+
+    if (tree->root == NULL)
+        return tree_verify(tree);
+
+    verify_ctx_t vc;
+    atomic_init(&vc.seen,   0);
+    atomic_init(&vc.status, OK);
+
+    err_t status = pool_run(pool, verify_task, &vc, tree->root, NULL, NULL);
+    if (status != OK) return status;
+
+    status = (err_t)atomic_load(&vc.status);
+    if (status != OK) return status;
+
+    const size_t seen = atomic_load(&vc.seen);
+    if (!CHECK(ERROR, seen == tree->nodes_amount,
+               "tree_par_verify: nodes_amount=%zu but reached %zu", tree->nodes_amount, seen))
+        return ERR_CORRUPT;
+
+    return OK;
+}
@@ -0,0 +1,37 @@
+#ifndef TPARALLEL_H
+#define TPARALLEL_H
+
+#include "../tree.h"
+#include "../iter/iter.h"
+#include "../../../libs/pool/pool.h"
+#include "../../../libs/logging/logging.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+// Subtrees taller than this (over ~4096 nodes) are split into pool tasks
+#define TREE_PAR_CUTOFF 12
+
+typedef int64_t (*tree_map_t)   (const node_t * const node, void * const ctx);
+typedef int64_t (*tree_reduce_t)(const int64_t a, const int64_t b);
+
+/*
+    Release every slab block of tree, blocks are split across the workers
+*/
+err_t tree_par_clear(tree_t * const tree, pool_t * const pool);
+
+/*
+    Fold map(node) of every node with reduce, which must be associative and
+    commutative, identity is its neutral element
+*/
+err_t tree_par_map_reduce(const tree_t * const tree, pool_t * const pool,
+                          tree_map_t map, tree_reduce_t reduce, const int64_t identity,
+                          void * const ctx, int64_t * const result);
+
+/*
+    Check key order, stored heights, AVL balance and node count in parallel
+*/
+err_t tree_par_verify(const tree_t * const tree, pool_t * const pool);
+
+#endif
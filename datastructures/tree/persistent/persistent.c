@@ -0,0 +1,345 @@
+#include "persistent.h"
+
+#define PATH_MAX_DEPTH (2 * TREE_MAX_HEIGHT + 2)
+
+// Tags the nodes created by one update, process wide so versions never collide
+static _Atomic uint64_t s_gen = 1;
+
+typedef struct
+{
+    const allocator_t* allocator;
+    uint64_t           gen;
+    bool               failed;
+} op_t;
+
+static inline int height_of(const pnode_t* node)
+{
+    return node ? node->height : 0;
+}
+
+static inline void update(pnode_t* node)
+{
+    const int hl = height_of(node->left);
+    const int hr = height_of(node->right);
+    node->height = 1 + (hl > hr ? hl : hr);
+}
+
+static inline pnode_t* retain(pnode_t* node)
+{
+    if (node) atomic_fetch_add_explicit(&node->refs, 1, memory_order_relaxed);
+    return node;
+}
+
+static inline size_t node_size(const pnode_t* node)
+{
+    return sizeof(pnode_t) + node->key.len + 1;
+}
+
+static void release(const allocator_t * const allocator, pnode_t* node)
+{
+    // A freed node pushes two children in place of itself: height + 1 slots
+    pnode_t* stack[PATH_MAX_DEPTH];
+    size_t   head = 0;
+
+    if (node) stack[head++] = node;
+    while (head > 0)
+    {
+        node = stack[--head];
+        if (atomic_fetch_sub_explicit(&node->refs, 1, memory_order_acq_rel) != 1) continue;
+
+        if (node->left)  stack[head++] = node->left;
+        if (node->right) stack[head++] = node->right;
+        mem_free(allocator, node, node_size(node));
+    }
+}
+
+static pnode_t* node_make(op_t * const op, const char * const data, const tree_key_t * const key)
+{
+    pnode_t* node = (pnode_t*)mem_alloc(op->allocator, sizeof(pnode_t) + key->len + 1);
+    if (!CHECK(ERROR, node != NULL, "ptree: node alloc failed"))
+    {
+        op->failed = true;
+        return NULL;
+    }
+
+    node->left   = NULL;
+    node->right  = NULL;
+    atomic_init(&node->refs, 1);
+    node->height = 1;
+    node->gen    = op->gen;
+    node->key    = *key;
+    memcpy(node->data, data, key->len + 1);
+
+    return node;
+}
+
+// Copy of node that links to its children with fresh references
+static pnode_t* node_clone(op_t * const op, const pnode_t * const node)
+{
+    pnode_t* copy = node_make(op, node->data, &node->key);
+    if (copy == NULL) return NULL;
+
+    copy->left   = retain(node->left);
+    copy->right  = retain(node->right);
+    copy->height = node->height;
+    return copy;
+}
+
+// Make *link writable by this update, copying it if an older version shares it
+static pnode_t* own(op_t * const op, pnode_t ** const link)
+{
+    pnode_t* node = *link;
+    if (node == NULL || op->failed || node->gen == op->gen) return node;
+
+    pnode_t* copy = node_clone(op, node);
+    if (copy == NULL) return node;
+
+    release(op->allocator, node);
+    *link = copy;
+    return copy;
+}
+
+static void rotate_left(op_t * const op, pnode_t ** const link)
+{
+    pnode_t* x = own(op, link);
+    pnode_t* y = own(op, &x->right);
+    if (op->failed) return;
+
+    x->right = y->left;
+    y->left  = x;
+    update(x);
+    update(y);
+    *link = y;
+}
+
+static void rotate_right(op_t * const op, pnode_t ** const link)
+{
+    pnode_t* x = own(op, link);
+    pnode_t* y = own(op, &x->left);
+    if (op->failed) return;
+
+    x->left  = y->right;
+    y->right = x;
+    update(x);
+    update(y);
+    *link = y;
+}
+
+// *link is owned by the update
+static void rebalance(op_t * const op, pnode_t ** const link)
+{
+    pnode_t* node = *link;
+    update(node);
+
+    const int balance = height_of(node->left) - height_of(node->right);
+    if (balance > 1)
+    {
+        if (height_of(node->left->left) < height_of(node->left->right))
+            rotate_left(op, &node->left);
+        if (!op->failed) rotate_right(op, link);
+    }
+    else if (balance < -1)
+    {
+        if (height_of(node->right->right) < height_of(node->right->left))
+            rotate_right(op, &node->right);
+        if (!op->failed) rotate_left(op, link);
+    }
+}
+
+/*
+    Rebuilds path[depth - 1] .. path[0] bottom-up around child, the new
+    subtree under path[depth - 1] in direction dirs[depth - 1]. The slot
+    of skip (if any) is taken by a copy of succ. Consumes child
+*/
+static pnode_t* rebuild(op_t * const op, const pnode_t * const * const path, const bool * const dirs,
+                        size_t depth, pnode_t* child, const pnode_t * const skip, const pnode_t * const succ)
+{
+    while (depth-- > 0)
+    {
+        const pnode_t* orig = path[depth];
+        pnode_t* copy = NULL;
+
+        if (orig == skip)
+        {
+            copy = node_make(op, succ->data, &succ->key);
+            if (copy) copy->left = retain(orig->left);
+        } else {
+            copy = node_make(op, orig->data, &orig->key);
+            if (copy) {
+                if (dirs[depth]) copy->left  = retain(orig->left);
+                else             copy->right = retain(orig->right);
+            }
+        }
+
+        if (copy == NULL)
+        {
+            release(op->allocator, child);
+            return NULL;
+        }
+
+        if (dirs[depth]) copy->right = child;
+        else             copy->left  = child;
+
+        child = copy;
+        rebalance(op, &child);
+        if (op->failed)
+        {
+            release(op->allocator, child);
+            return NULL;
+        }
+    }
+    return child;
+}
+
+static void publish(const ptree_t * const from, ptree_t * const to, pnode_t * const root, const size_t amount)
+{
+    const allocator_t* allocator = from->allocator;
+
+    if (to != from) ptree_dtor(to);
+    else            release(allocator, to->root);
+
+    to->root         = root;
+    to->nodes_amount = amount;
+    to->allocator    = allocator;
+}
+
+err_t ptree_ctor(ptree_t * const tree, const allocator_t * const allocator)
+{
+    if (!CHECK(ERROR, tree != NULL, "ptree_ctor: tree is NULL"))
+        return ERR_BAD_ARG;
+
+    tree->root         = NULL;
+    tree->nodes_amount = 0;
+    tree->allocator    = allocator;
+    return OK;
+}
+
+err_t ptree_dtor(ptree_t * const tree)
+{
+    if (!CHECK(ERROR, tree != NULL, "ptree_dtor: tree is NULL"))
+        return ERR_BAD_ARG;
+
+    release(tree->allocator, tree->root);
+    tree->root         = NULL;
+    tree->nodes_amount = 0;
+    return OK;
+}
+
+err_t ptree_snapshot(const ptree_t * const from, ptree_t * const to)
+{
+    if (!CHECK(ERROR, from != NULL && to != NULL, "ptree_snapshot: bad args"))
+        return ERR_BAD_ARG;
+    if (from == to) return OK;
+
+    pnode_t* root = retain(from->root);
+    publish(from, to, root, from->nodes_amount);
+    return OK;
+}
+
+err_t ptree_insert(const ptree_t * const from, const char * const data, ptree_t * const to)
+{
+    if (!CHECK(ERROR, from != NULL && to != NULL && data != NULL, "ptree_insert: bad args"))
+        return ERR_BAD_ARG;
+
+    tree_key_t key;
+    tree_key_parse(data, &key);
+
+    const pnode_t* path[PATH_MAX_DEPTH];
+    bool           dirs[PATH_MAX_DEPTH];
+    size_t         depth = 0;
+
+    for (const pnode_t* cur = from->root; cur != NULL; )
+    {
+        if (!CHECK(ERROR, depth < TREE_MAX_HEIGHT, "ptree_insert: descent exceeded limit"))
+            return ERR_CORRUPT;
+
+        const bool right = tree_key_compare(&cur->key, cur->data, &key, data) <= 0;
+        path[depth]   = cur;
+        dirs[depth++] = right;
+        cur = right ? cur->right : cur->left;
+    }
+
+    op_t op = { from->allocator, atomic_fetch_add(&s_gen, 1), false };
+
+    pnode_t* leaf = node_make(&op, data, &key);
+    if (leaf == NULL) return ERR_ALLOC;
+
+    pnode_t* root = rebuild(&op, path, dirs, depth, leaf, NULL, NULL);
+    if (root == NULL) return ERR_ALLOC;
+
+    publish(from, to, root, from->nodes_amount + 1);
+    return OK;
+}
+
+err_t ptree_delete(const ptree_t * const from, const char * const key, ptree_t * const to)
+{
+    if (!CHECK(ERROR, from != NULL && to != NULL && key != NULL, "ptree_delete: bad args"))
+        return ERR_BAD_ARG;
+
+    tree_key_t k;
+    tree_key_parse(key, &k);
+
+    const pnode_t* path[PATH_MAX_DEPTH];
+    bool           dirs[PATH_MAX_DEPTH];
+    size_t         depth  = 0;
+    const pnode_t* target = from->root;
+
+    while (target != NULL)
+    {
+        const int cmp = tree_key_compare(&k, key, &target->key, target->data);
+        if (cmp == 0) break;
+
+        path[depth]   = target;
+        dirs[depth++] = cmp > 0;
+        target = (cmp > 0) ? target->right : target->left;
+    }
+
+    if (target == NULL) return ERR_NOT_FOUND;
+
+    op_t op = { from->allocator, atomic_fetch_add(&s_gen, 1), false };
+
+    // Successor's ancestors below target are rebuilt too, target's slot gets the successor
+    pnode_t*       child = NULL;
+    const pnode_t* succ  = NULL;
+    if (target->right == NULL) {
+        child = retain(target->left);
+    } else {
+        path[depth]   = target;
+        dirs[depth++] = true;
+
+        succ = target->right;
+        while (succ->left != NULL)
+        {
+            path[depth]   = succ;
+            dirs[depth++] = false;
+            succ = succ->left;
+        }
+        child = retain(succ->right);
+    }
+
+    pnode_t* root = rebuild(&op, path, dirs, depth, child, succ ? target : NULL, succ);
+    if (root == NULL && op.failed) return ERR_ALLOC;
+
+    publish(from, to, root, from->nodes_amount - 1);
+    return OK;
+}
+
+err_t ptree_find(const ptree_t * const tree, const char * const key, const pnode_t ** const found)
+{
+    if (!CHECK(ERROR, tree != NULL && found != NULL, "ptree_find: bad args"))
+        return ERR_BAD_ARG;
+
+    tree_key_t k;
+    tree_key_parse(key, &k);
+
+    const pnode_t* cur = tree->root;
+    while (cur != NULL)
+    {
+        const int cmp = tree_key_compare(&k, key, &cur->key, cur->data);
+        if (cmp == 0) break;
+        cur = (cmp < 0) ? cur->left : cur->right;
+    }
+
+    *found = cur;
+    return cur ? OK : ERR_NOT_FOUND;
+}
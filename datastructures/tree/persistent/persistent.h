@@ -0,0 +1,61 @@
+#ifndef TPERSISTENT_H
+#define TPERSISTENT_H
+
+#include "../tree.h"
+#include "../../../libs/logging/logging.h"
+#include "../../../libs/alloc/alloc.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+/*
+    Immutable, reference counted node. Every parent link and every version
+    root holds one reference. gen is the update that created the node, only
+    that update may still modify it. Key bytes follow the node in the same block
+*/
+typedef struct pnode_t
+{
+    struct pnode_t*   left;
+    struct pnode_t*   right;
+    _Atomic uint32_t  refs;
+    int               height;
+    uint64_t          gen;
+    tree_key_t        key;
+    char              data[];
+} pnode_t;
+
+/*
+    Version handle of a persistent AVL tree. Updates copy the root-to-leaf
+    path only and produce a new version, the source version stays readable
+    until it is released. Versions may be read and released from any thread
+*/
+typedef struct
+{
+    pnode_t*            root;
+    size_t              nodes_amount;
+    const allocator_t*  allocator;
+} ptree_t;
+
+#define CREATE_PTREE(tree_name) \
+    ptree_t tree_name = { 0 };  \
+    ptree_ctor(&tree_name, NULL)
+
+err_t ptree_ctor(ptree_t * const tree, const allocator_t * const allocator);
+err_t ptree_dtor(ptree_t * const tree);
+
+/*
+    O(1): to shares every node of from
+*/
+err_t ptree_snapshot(const ptree_t * const from, ptree_t * const to);
+
+/*
+    to receives the updated version, it may be the same handle as from,
+    otherwise its previous version is released. On failure to is untouched
+*/
+err_t ptree_insert(const ptree_t * const from, const char * const data, ptree_t * const to);
+err_t ptree_delete(const ptree_t * const from, const char * const key,  ptree_t * const to);
+
+err_t ptree_find  (const ptree_t * const tree, const char * const key, const pnode_t ** const found);
+
+#endif
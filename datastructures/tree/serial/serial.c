@@ -0,0 +1,503 @@
+#include "serial.h"
+#include "../iter/iter.h"
+
+#include <errno.h>
+#include <unistd.h>
+
+#define READ_CHUNK ((size_t)64 * 1024)
+
+// Magic plus the node count
+#define BIN_HEADER  (sizeof(TREE_BIN_MAGIC) - 1 + sizeof(uint64_t))
+// Flags byte plus up to ten LEB128 bytes of the length
+#define BIN_RECORD  11
+
+void tree_sink_file(tree_sink_t * const sink, FILE * const file, char * const buffer, const size_t capacity)
+{
+    *sink = (tree_sink_t){ file, -1, buffer, buffer ? capacity : 0, 0, 0, OK };
+}
+
+void tree_sink_fd(tree_sink_t * const sink, const int fd, char * const buffer, const size_t capacity)
+{
+    *sink = (tree_sink_t){ NULL, fd, buffer, buffer ? capacity : 0, 0, 0, OK };
+}
+
+err_t tree_sink_flush(tree_sink_t * const sink)
+{
+    if (!CHECK(ERROR, sink != NULL, "tree_sink_flush: sink is NULL"))
+        return ERR_BAD_ARG;
+
+    size_t done = 0;
+    while (sink->status == OK && done < sink->used)
+    {
+        const size_t left = sink->used - done;
+        if (sink->file != NULL)
+        {
+            const size_t put = fwrite(sink->buffer + done, 1, left, sink->file);
+            if (put < left) sink->status = ERR_CORRUPT;
+            done += put;
+        } else {
+            const ssize_t put = write(sink->fd, sink->buffer + done, left);
+            if (put < 0 && errno == EINTR) continue;
+            if (put <= 0) sink->status = ERR_CORRUPT;
+            else          done += (size_t)put;
+        }
+    }
+
+    if (sink->status != OK)
+        log_printf(ERROR, "tree_sink_flush: write failed after %zu bytes", sink->written + done);
+
+    sink->written += done;
+    sink->used     = 0;
+    return sink->status;
+}
+
+// Room for size more bytes, flushes when the buffer can not take them
+static inline bool reserve(tree_sink_t * const sink, const size_t size)
+{
+    if (sink->used + size <= sink->capacity) return true;
+    (void)tree_sink_flush(sink);
+    return sink->status == OK && size <= sink->capacity;
+}
+
+static void put_bytes(tree_sink_t * const sink, const char* bytes, size_t size)
+{
+    // Keys longer than the buffer go through in buffer-sized pieces
+    while (size > 0 && sink->status == OK)
+    {
+        const size_t piece = size < sink->capacity ? size : sink->capacity;
+        if (!reserve(sink, piece)) return;
+
+        memcpy(sink->buffer + sink->used, bytes, piece);
+        sink->used += piece;
+        bytes      += piece;
+        size       -= piece;
+    }
+}
+
+static inline void put_char(tree_sink_t * const sink, const char c)
+{
+    if (reserve(sink, 1)) sink->buffer[sink->used++] = c;
+}
+
+static void put_leb128(tree_sink_t * const sink, uint64_t value)
+{
+    if (!reserve(sink, BIN_RECORD)) return;
+    do {
+        const uint8_t byte = (uint8_t)(value & 0x7f);
+        value >>= 7;
+        sink->buffer[sink->used++] = (char)(byte | (value ? 0x80 : 0));
+    } while (value);
+}
+
+static err_t write_text(const node_t * const node, tree_sink_t * const sink,
+                        const allocator_t * const allocator)
+{
+    tree_iter_t it;
+    (void)tree_iter_begin_node(&it, (node_t*)node, allocator, TREE_EULER);
+
+    const node_t* cur = NULL;
+    while (sink->status == OK && (cur = tree_iter_next(&it)) != NULL)
+    {
+        if (it.visit == TREE_PREORDER) {
+            put_char(sink, '(');
+        } else if (it.visit == TREE_INORDER) {
+            put_char (sink, '"');
+            put_bytes(sink, node_data(cur), cur->key.len);
+            put_char (sink, '"');
+        } else {
+            put_char(sink, ')');
+        }
+    }
+
+    const err_t status = it.status;
+    tree_iter_end(&it);
+    return status;
+}
+
+static err_t write_binary(const node_t * const node, tree_sink_t * const sink,
+                          const allocator_t * const allocator, size_t amount)
+{
+    tree_iter_t it;
+    if (amount == SIZE_MAX)
+    {
+        amount = 0;
+        (void)tree_iter_begin_node(&it, (node_t*)node, allocator, TREE_PREORDER);
+        while (tree_iter_next(&it) != NULL) amount++;
+        tree_iter_end(&it);
+    }
+
+    char header[BIN_HEADER];
+    memcpy(header, TREE_BIN_MAGIC, sizeof(TREE_BIN_MAGIC) - 1);
+    for (size_t i = 0; i < sizeof(uint64_t); ++i)
+        header[sizeof(TREE_BIN_MAGIC) - 1 + i] = (char)((uint64_t)amount >> (8 * i));
+    put_bytes(sink, header, sizeof(header));
+
+    (void)tree_iter_begin_node(&it, (node_t*)node, allocator, TREE_PREORDER);
+
+    const node_t* cur = NULL;
+    while (sink->status == OK && (cur = tree_iter_next(&it)) != NULL)
+    {
+        put_char  (sink, (char)((cur->left ? TREE_BIN_LEFT : 0) | (cur->right ? TREE_BIN_RIGHT : 0)));
+        put_leb128(sink, cur->key.len);
+        put_bytes (sink, node_data(cur), cur->key.len);
+    }
+
+    const err_t status = it.status;
+    tree_iter_end(&it);
+    return status;
+}
+
+static err_t write_subtree(const node_t * const node, tree_sink_t * const sink, const tree_format_t format,
+                           const allocator_t * const allocator, const size_t amount)
+{
+    if (!CHECK(ERROR, sink != NULL && sink->status == OK, "tree_write: bad sink") ||
+        !CHECK(ERROR, format == TREE_FORMAT_TEXT || format == TREE_FORMAT_BINARY,
+               "tree_write: bad format %d", (int)format))
+        return ERR_BAD_ARG;
+
+    if (!CHECK(ERROR, sink->buffer == NULL || sink->capacity >= BIN_RECORD,
+               "tree_write: sink buffer of %zu bytes is too small", sink->capacity))
+        return ERR_BAD_ARG;
+
+    char* own = NULL;
+    if (sink->buffer == NULL)
+    {
+        own = (char*)mem_alloc(allocator, TREE_SINK_BUFFER);
+        if (!CHECK(ERROR, own != NULL, "tree_write: buffer alloc failed"))
+            return ERR_ALLOC;
+
+        sink->buffer   = own;
+        sink->capacity = TREE_SINK_BUFFER;
+        sink->used     = 0;
+    }
+
+    err_t rc = (format == TREE_FORMAT_TEXT) ? (node ? write_text(node, sink, allocator) : OK)
+                                            : write_binary(node, sink, allocator, amount);
+    const err_t flushed = tree_sink_flush(sink);
+    if (rc == OK) rc = flushed;
+
+    if (own != NULL)
+    {
+        mem_free(allocator, own, TREE_SINK_BUFFER);
+        sink->buffer   = NULL;
+        sink->capacity = 0;
+    }
+    return rc;
+}
+
+err_t tree_write(const tree_t * const tree, tree_sink_t * const sink, const tree_format_t format)
+{
+    if (!CHECK(ERROR, tree != NULL, "tree_write: tree is NULL"))
+        return ERR_BAD_ARG;
+
+    return write_subtree(tree->root, sink, format, tree->allocator, tree->nodes_amount);
+}
+
+err_t tree_write_node(const node_t * const node, tree_sink_t * const sink, const tree_format_t format,
+                      const allocator_t * const allocator)
+{
+    return write_subtree(node, sink, format, allocator, SIZE_MAX);
+}
+
+typedef struct
+{
+    node_t* node;
+    node_t* left;
+} load_frame_t;
+
+static inline bool is_blank(const char c)
+{
+    return c == ' ' || c == '\n' || c == '\t' || c == '\r';
+}
+
+static inline int height_of(const node_t * const node)
+{
+    return node ? node->height : 0;
+}
+
+// Closing quote of a key starting at p: the first one whose next token is a parenthesis
+static const char* key_end(const char* p, const char * const last)
+{
+    for (;;)
+    {
+        p = (const char*)memchr(p, '"', (size_t)(last - p));
+        if (p == NULL) return NULL;
+
+        const char* q = p + 1;
+        while (q < last && is_blank(*q)) q++;
+        if (q == last) return NULL;
+        if (*q == '(' || *q == ')') return p;
+        p++;
+    }
+}
+
+static err_t parse(tree_t * const tree, const char * const buffer, const size_t size)
+{
+    load_frame_t  stack[TREE_MAX_HEIGHT + 1];
+    size_t        top  = 0;
+    const node_t* prev = NULL;
+
+    const char* p    = buffer;
+    const char* last = buffer + size;
+
+    while (p < last)
+    {
+        const char c = *p;
+        if (is_blank(c)) { p++; continue; }
+
+        if (c == '(')
+        {
+            if (!CHECK(ERROR, tree->root == NULL, "tree_load: data after the tree at %zu", (size_t)(p - buffer)) ||
+                !CHECK(ERROR, top < TREE_MAX_HEIGHT, "tree_load: nesting deeper than %d", TREE_MAX_HEIGHT))
+                return ERR_CORRUPT;
+
+            // Second subtree on the same side
+            if (top > 0 && !CHECK(ERROR, stack[top - 1].node ? stack[top - 1].node->right == NULL
+                                                              : stack[top - 1].left == NULL,
+                                  "tree_load: extra subtree at %zu", (size_t)(p - buffer)))
+                return ERR_CORRUPT;
+
+            stack[top++] = (load_frame_t){ NULL, NULL };
+            p++;
+        }
+        else if (c == '"')
+        {
+            if (!CHECK(ERROR, top > 0 && stack[top - 1].node == NULL,
+                       "tree_load: unexpected key at %zu", (size_t)(p - buffer)))
+                return ERR_CORRUPT;
+
+            const char* key = p + 1;
+            const char* q   = key_end(key, last);
+            if (!CHECK(ERROR, q != NULL, "tree_load: unterminated key at %zu", (size_t)(p - buffer)))
+                return ERR_CORRUPT;
+
+            tree_key_t parsed;
+            tree_key_parse_n(key, (size_t)(q - key), &parsed);
+
+            node_t* node = tree_node_new(tree, key, &parsed);
+            if (node == NULL) return ERR_ALLOC;
+            tree->nodes_amount += 1;
+            TREE_STAT(tree, inserts, 1);
+
+            // Keys come in order, each one must not be less than the previous
+            if (!CHECK(ERROR, prev == NULL || tree_key_compare(&prev->key, node_data(prev),
+                                                               &node->key, node_data(node)) <= 0,
+                       "tree_load: key \"%s\" out of order", node_data(node)))
+                return ERR_CORRUPT;
+
+            node->left = stack[top - 1].left;
+            stack[top - 1].node = node;
+            prev = node;
+            p = q + 1;
+        }
+        else if (c == ')')
+        {
+            if (!CHECK(ERROR, top > 0 && stack[top - 1].node != NULL,
+                       "tree_load: unexpected ')' at %zu", (size_t)(p - buffer)))
+                return ERR_CORRUPT;
+
+            node_t*   node = stack[--top].node;
+            const int hl   = height_of(node->left);
+            const int hr   = height_of(node->right);
+            if (!CHECK(ERROR, hl - hr <= 1 && hr - hl <= 1,
+                       "tree_load: unbalanced node \"%s\" (%d/%d)", node_data(node), hl, hr))
+                return ERR_CORRUPT;
+            node->height = 1 + (hl > hr ? hl : hr);
+
+            if      (top == 0)                   tree->root = node;
+            else if (stack[top - 1].node == NULL) stack[top - 1].left = node;
+            else                                  stack[top - 1].node->right = node;
+            p++;
+        }
+        else
+        {
+            log_printf(ERROR, "tree_load: unexpected '%c' at %zu", c, (size_t)(p - buffer));
+            return ERR_CORRUPT;
+        }
+    }
+
+    if (!CHECK(ERROR, top == 0, "tree_load: %zu unclosed nodes", top))
+        return ERR_CORRUPT;
+    return OK;
+}
+
+static bool get_leb128(const char ** const p, const char * const last, uint64_t * const value)
+{
+    *value = 0;
+    for (unsigned shift = 0; *p < last && shift < 64; shift += 7)
+    {
+        const uint8_t byte = (uint8_t)*(*p)++;
+        *value |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+static err_t parse_binary(tree_t * const tree, const char * const buffer, const size_t size)
+{
+    const char* p    = buffer + sizeof(TREE_BIN_MAGIC) - 1;
+    const char* last = buffer + size;
+
+    uint64_t amount = 0;
+    for (size_t i = 0; i < sizeof(uint64_t); ++i)
+        amount |= (uint64_t)(uint8_t)*p++ << (8 * i);
+
+    // Every record takes at least the flags byte and one length byte
+    if (!CHECK(ERROR, amount <= (size - BIN_HEADER) / 2, "tree_load: %llu nodes can not fit in %zu bytes",
+               (unsigned long long)amount, size))
+        return ERR_CORRUPT;
+    if (amount == 0) return (p == last) ? OK : ERR_CORRUPT;
+
+    const size_t n     = (size_t)amount;
+    node_t*      block = (node_t*)slab_carve(&tree->slab, tree->allocator, n * sizeof(node_t), sizeof(void*));
+    if (!CHECK(ERROR, block != NULL, "tree_load: node block alloc failed (%zu nodes)", n))
+        return ERR_ALLOC;
+
+    // Links still to be filled, right below left so that the left subtree comes first
+    node_t** links[TREE_MAX_HEIGHT + 2];
+    size_t   top = 0;
+    links[top++] = &tree->root;
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (!CHECK(ERROR, top > 0 && p < last, "tree_load: node %zu has no parent", i))
+            return ERR_CORRUPT;
+
+        const uint8_t flags = (uint8_t)*p++;
+        uint64_t      len   = 0;
+        if (!CHECK(ERROR, get_leb128(&p, last, &len) && len <= (uint64_t)(last - p),
+                   "tree_load: bad key length of node %zu", i))
+            return ERR_CORRUPT;
+
+        node_t* node = &block[i];
+        memset(node, 0, sizeof(*node));
+        tree_key_parse_n(p, (size_t)len, &node->key);
+
+        if (len < TREE_INLINE_KEY) {
+            memcpy(node->data.small, p, (size_t)len);
+            node->is_inline = true;
+        } else {
+            char* copy = (char*)slab_bytes_alloc(&tree->slab, tree->allocator, (size_t)len + 1);
+            if (!CHECK(ERROR, copy != NULL, "tree_load: key alloc failed (%llu)", (unsigned long long)len))
+                return ERR_ALLOC;
+            memcpy(copy, p, (size_t)len);
+            copy[len] = '\0';
+            node->data.heap = copy;
+            TREE_STAT(tree, heap_key_bytes, (size_t)len + 1);
+        }
+        TREE_STAT(tree, key_bytes, (size_t)len);
+        p += len;
+
+        *links[--top] = node;
+        if (!CHECK(ERROR, top + 2 <= TREE_MAX_HEIGHT + 2, "tree_load: nesting deeper than %d", TREE_MAX_HEIGHT))
+            return ERR_CORRUPT;
+        if (flags & TREE_BIN_RIGHT) links[top++] = &node->right;
+        if (flags & TREE_BIN_LEFT)  links[top++] = &node->left;
+    }
+
+    if (!CHECK(ERROR, top == 0 && p == last, "tree_load: %zu subtrees missing, %zu bytes left",
+               top, (size_t)(last - p)))
+        return ERR_CORRUPT;
+    tree->nodes_amount = n;
+    TREE_STAT(tree, inserts, n);
+
+    // Descendants follow their node in preorder: a backward pass sees children first
+    for (size_t i = n; i-- > 0; )
+    {
+        node_t*   node = &block[i];
+        const int hl   = height_of(node->left);
+        const int hr   = height_of(node->right);
+        if (!CHECK(ERROR, hl - hr <= 1 && hr - hl <= 1,
+                   "tree_load: unbalanced node \"%s\" (%d/%d)", node_data(node), hl, hr))
+            return ERR_CORRUPT;
+        node->height = 1 + (hl > hr ? hl : hr);
+    }
+
+    tree_iter_t it;
+    (void)tree_iter_begin(&it, tree, TREE_INORDER);
+
+    err_t         rc   = OK;
+    const node_t* prev = NULL;
+    const node_t* cur  = NULL;
+    while ((cur = tree_iter_next(&it)) != NULL)
+    {
+        if (prev && !CHECK(ERROR, tree_key_compare(&prev->key, node_data(prev), &cur->key, node_data(cur)) <= 0,
+                           "tree_load: key \"%s\" out of order", node_data(cur)))
+        {
+            rc = ERR_CORRUPT;
+            break;
+        }
+        prev = cur;
+    }
+
+    if (rc == OK) rc = it.status;
+    tree_iter_end(&it);
+    return rc;
+}
+
+err_t tree_load_buffer(tree_t * const tree, const char * const buffer, const size_t size)
+{
+    if (!CHECK(ERROR, tree != NULL && (buffer != NULL || size == 0), "tree_load_buffer: bad args"))
+        return ERR_BAD_ARG;
+
+    (void)tree_clear(tree);
+
+    const size_t magic = sizeof(TREE_BIN_MAGIC) - 1;
+    const bool   binary = size >= magic && memcmp(buffer, TREE_BIN_MAGIC, magic) == 0;
+    if (binary && !CHECK(ERROR, size >= BIN_HEADER, "tree_load: truncated binary header"))
+        return ERR_CORRUPT;
+
+    const err_t rc = binary ? parse_binary(tree, buffer, size) : parse(tree, buffer, size);
+    if (rc != OK) (void)tree_clear(tree);
+    return rc;
+}
+
+err_t tree_load(tree_t * const tree, FILE * const file)
+{
+    if (!CHECK(ERROR, tree != NULL && file != NULL, "tree_load: bad args"))
+        return ERR_BAD_ARG;
+
+    // The data starts at the stream position, a stream without one is only read
+    size_t      size   = 0;
+    const off_t start  = ftello(file);
+    char*       mapped = (start >= 0) ? map_file(file, &size) : NULL;
+    if (mapped != NULL && (size_t)start <= size)
+    {
+        const err_t rc = tree_load_buffer(tree, mapped + start, size - (size_t)start);
+        unmap_file(mapped, size);
+        if (fseeko(file, (off_t)size, SEEK_SET) != 0)
+            log_printf(WARN, "tree_load: can't move the stream past %zu bytes", size);
+        return rc;
+    }
+    unmap_file(mapped, size);
+    size = 0;
+
+    const allocator_t* a = tree->allocator;
+
+    size_t capacity = READ_CHUNK;
+    char*  buffer   = (char*)mem_alloc(a, capacity);
+    if (!CHECK(ERROR, buffer != NULL, "tree_load: read buffer alloc failed"))
+        return ERR_ALLOC;
+
+    size_t got = 0;
+    while ((got = fread(buffer + size, 1, capacity - size, file)) > 0)
+    {
+        size += got;
+        if (size < capacity) continue;
+
+        char* grown = (char*)mem_realloc(a, buffer, capacity, 2 * capacity);
+        if (!CHECK(ERROR, grown != NULL, "tree_load: read buffer alloc failed (%zu)", 2 * capacity))
+        {
+            mem_free(a, buffer, capacity);
+            return ERR_ALLOC;
+        }
+        buffer    = grown;
+        capacity *= 2;
+    }
+
+    err_t rc = ERR_CORRUPT;
+    if (ferror(file)) log_printf(ERROR, "tree_load: read failed after %zu bytes", size);
+    else              rc = tree_load_buffer(tree, buffer, size);
+    mem_free(a, buffer, capacity);
+    return rc;
+}
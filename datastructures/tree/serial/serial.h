@@ -0,0 +1,80 @@
+#ifndef TSERIAL_H
+#define TSERIAL_H
+
+#include "../tree.h"
+#include "../../../libs/logging/logging.h"
+#include "../../../libs/alloc/alloc.h"
+#include "../../../libs/io/io.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Buffer allocated by tree_write when the sink brings none
+#define TREE_SINK_BUFFER ((size_t)1 << 20)
+
+/*
+    Binary form: magic, node count (8 bytes little-endian), then nodes in
+    preorder as a flags byte (TREE_BIN_LEFT/RIGHT), a LEB128 key length
+    and the key bytes
+*/
+#define TREE_BIN_MAGIC "TRB1"
+#define TREE_BIN_LEFT  0x1
+#define TREE_BIN_RIGHT 0x2
+
+typedef enum
+{
+    TREE_FORMAT_TEXT   = 0,
+    TREE_FORMAT_BINARY = 1,
+} tree_format_t;
+
+/*
+    Output buffer flushed in whole-buffer writes to file or, without
+    one, to fd. status keeps the first write error
+*/
+typedef struct
+{
+    FILE*  file;
+    int    fd;
+
+    char*  buffer;
+    size_t capacity;
+    size_t used;
+
+    size_t written;
+    err_t  status;
+} tree_sink_t;
+
+/*
+    buffer may be NULL, tree_write then brings its own for the call
+*/
+void  tree_sink_file (tree_sink_t * const sink, FILE * const file, char * const buffer, const size_t capacity);
+void  tree_sink_fd   (tree_sink_t * const sink, const int fd,      char * const buffer, const size_t capacity);
+err_t tree_sink_flush(tree_sink_t * const sink);
+
+/*
+    Serialize the subtree of node (NULL writes nothing in text form) and
+    flush the sink. Text form is the one of tree_print
+*/
+err_t tree_write     (const tree_t * const tree, tree_sink_t * const sink, const tree_format_t format);
+err_t tree_write_node(const node_t * const node, tree_sink_t * const sink, const tree_format_t format,
+                      const allocator_t * const allocator);
+
+/*
+    Replace the contents of tree with the one printed by tree_print:
+    (left "key" right), subtrees optional, whitespace between tokens is
+    skipped. A key ends at the first quote whose next token is a parenthesis,
+    so a key can not hold a quote followed by blanks and a parenthesis.
+    Input starting with TREE_BIN_MAGIC is read as the binary form.
+    The shape is kept as written and checked to be an ordered AVL tree,
+    any error leaves the tree empty
+*/
+err_t tree_load_buffer(tree_t * const tree, const char * const buffer, const size_t size);
+
+/*
+    Reads from the current position of file to its end and leaves the
+    stream there. Regular files are mapped, other streams are read first
+*/
+err_t tree_load(tree_t * const tree, FILE * const file);
+
+#endif
@@ -0,0 +1,148 @@
+#include "slab.h"
+
+#define BLOCK_HEADER (sizeof(slab_block_t) + (16 - sizeof(slab_block_t) % 16) % 16)
+
+void slab_init(tslab_t * const slab, const size_t record_size)
+{
+    slab_init_aligned(slab, record_size, sizeof(void*));
+}
+
+void slab_init_aligned(tslab_t * const slab, const size_t record_size, const size_t align)
+{
+    *slab = (tslab_t){ 0 };
+    slab->record_size  = (record_size < sizeof(void*)) ? sizeof(void*) : record_size;
+    slab->record_align = (align < sizeof(void*)) ? sizeof(void*) : align;
+    slab->next_block   = SLAB_MIN_BLOCK;
+}
+
+static err_t slab_grow(tslab_t * const slab, const allocator_t * const allocator,
+                       const size_t need)
+{
+    size_t size = slab->next_block;
+    if (need + BLOCK_HEADER > size) size = need + BLOCK_HEADER;
+
+    slab_block_t* block = (slab_block_t*)mem_alloc(allocator, size);
+    if (!CHECK(ERROR, block != NULL, "slab_grow: block alloc failed (%zu bytes)", size))
+        return ERR_ALLOC;
+
+    block->next = slab->blocks;
+    block->size = size;
+    slab->blocks = block;
+
+    slab->bytes_wasted   += slab->left;
+    slab->cursor          = (char*)block + BLOCK_HEADER;
+    slab->left            = size - BLOCK_HEADER;
+    slab->blocks_amount  += 1;
+    slab->bytes_reserved += size;
+
+    if (slab->next_block < SLAB_MAX_BLOCK) slab->next_block *= 2;
+    return OK;
+}
+
+void* slab_carve(tslab_t * const slab, const allocator_t * const allocator,
+                 const size_t size, const size_t align)
+{
+    size_t pad = (size_t)(-(uintptr_t)slab->cursor) & (align - 1);
+    if (slab->cursor == NULL || pad + size > slab->left)
+    {
+        if (slab_grow(slab, allocator, size + align) != OK) return NULL;
+        pad = (size_t)(-(uintptr_t)slab->cursor) & (align - 1);
+    }
+
+    char* ptr = slab->cursor + pad;
+    slab->cursor += pad + size;
+    slab->left   -= pad + size;
+    slab->bytes_wasted += pad;
+    return ptr;
+}
+
+void slab_uncarve(tslab_t * const slab, void * const ptr, const size_t size)
+{
+    if (ptr == NULL) return;
+
+    if ((char*)ptr + size == slab->cursor)
+    {
+        slab->cursor -= size;
+        slab->left   += size;
+    } else {
+        slab->bytes_wasted += size;
+    }
+}
+
+// Class of a span, SLAB_BYTES_CLASSES when it has none
+static size_t bytes_class(const size_t size)
+{
+    if (size <= SLAB_BYTES_SMALL)
+        return (size + SLAB_BYTES_STEP - 1) / SLAB_BYTES_STEP - (size != 0);
+
+    size_t index = SLAB_BYTES_SMALL / SLAB_BYTES_STEP;
+    for (size_t span = SLAB_BYTES_SMALL * 2; span < size && span <= SLAB_MAX_BLOCK; span *= 2) ++index;
+    return (size <= SLAB_MAX_BLOCK) ? index : SLAB_BYTES_CLASSES;
+}
+
+size_t slab_bytes_size(const size_t size)
+{
+    if (size <= SLAB_BYTES_STEP)  return SLAB_BYTES_STEP;
+    if (size <= SLAB_BYTES_SMALL) return (size + SLAB_BYTES_STEP - 1) & ~(SLAB_BYTES_STEP - 1);
+    if (size >  SLAB_MAX_BLOCK)   return size;
+
+    size_t span = SLAB_BYTES_SMALL * 2;
+    while (span < size) span *= 2;
+    return span;
+}
+
+void* slab_bytes_alloc(tslab_t * const slab, const allocator_t * const allocator, const size_t size)
+{
+    const size_t index = bytes_class(size);
+    if (index < SLAB_BYTES_CLASSES && slab->free_bytes[index] != NULL)
+    {
+        void* ptr = slab->free_bytes[index];
+        memcpy(&slab->free_bytes[index], ptr, sizeof(void*));
+        return ptr;
+    }
+    return slab_carve(slab, allocator, slab_bytes_size(size), 1);
+}
+
+void slab_bytes_free(tslab_t * const slab, void * const ptr, const size_t size)
+{
+    if (ptr == NULL) return;
+
+    const size_t index = bytes_class(size);
+    if (index == SLAB_BYTES_CLASSES)
+    {
+        slab_uncarve(slab, ptr, size);
+        return;
+    }
+    memcpy(ptr, &slab->free_bytes[index], sizeof(void*));
+    slab->free_bytes[index] = ptr;
+}
+
+void* slab_record_alloc(tslab_t * const slab, const allocator_t * const allocator)
+{
+    if (slab->free_records != NULL)
+    {
+        void* record = slab->free_records;
+        memcpy(&slab->free_records, record, sizeof(void*));
+        return record;
+    }
+    return slab_carve(slab, allocator, slab->record_size, slab->record_align);
+}
+
+void slab_record_free(tslab_t * const slab, void * const record)
+{
+    if (record == NULL) return;
+    memcpy(record, &slab->free_records, sizeof(void*));
+    slab->free_records = record;
+}
+
+void slab_clear(tslab_t * const slab, const allocator_t * const allocator)
+{
+    slab_block_t* block = slab->blocks;
+    while (block != NULL)
+    {
+        slab_block_t* next = block->next;
+        mem_free(allocator, block, block->size);
+        block = next;
+    }
+    slab_init_aligned(slab, slab->record_size, slab->record_align);
+}
@@ -0,0 +1,85 @@
+#ifndef TSLAB_H
+#define TSLAB_H
+
+#include "../../../libs/logging/logging.h"
+#include "../../../libs/alloc/alloc.h"
+#include "../../../libs/types.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// First block size, each next block doubles up to SLAB_MAX_BLOCK
+#define SLAB_MIN_BLOCK ((size_t)16 * 1024)
+#define SLAB_MAX_BLOCK ((size_t)4 * 1024 * 1024)
+
+// Byte classes: 8 byte steps up to SLAB_BYTES_SMALL, powers of two up to SLAB_MAX_BLOCK
+#define SLAB_BYTES_STEP    ((size_t)8)
+#define SLAB_BYTES_SMALL   ((size_t)256)
+#define SLAB_BYTES_CLASSES (32 + 14)
+
+typedef struct slab_block_t
+{
+    struct slab_block_t* next;
+    size_t               size;
+} slab_block_t;
+
+/*
+    Bump arena with a free list of fixed-size records and one free list per
+    byte class. Records and raw bytes are carved from the same blocks,
+    released records and class bytes are reused, other released bytes are
+    only reclaimed when they are the last carve or on slab_clear
+*/
+typedef struct
+{
+    slab_block_t* blocks;
+    char*         cursor;
+    size_t        left;
+    size_t        next_block;
+
+    size_t        record_size;
+    size_t        record_align;
+    void*         free_records;
+    void*         free_bytes[SLAB_BYTES_CLASSES];
+
+    size_t        blocks_amount;
+    size_t        bytes_reserved;
+    size_t        bytes_wasted;
+} tslab_t;
+
+void  slab_init        (tslab_t * const slab, const size_t record_size);
+void  slab_init_aligned(tslab_t * const slab, const size_t record_size, const size_t align);
+
+/*
+    Carve size bytes aligned to align (power of two), NULL on alloc failure
+*/
+void* slab_carve(tslab_t * const slab, const allocator_t * const allocator,
+                 const size_t size, const size_t align);
+
+/*
+    Give back size bytes at ptr, reclaimed only if it was the last carve
+*/
+void  slab_uncarve(tslab_t * const slab, void * const ptr, const size_t size);
+
+/*
+    Size actually taken by slab_bytes_alloc(size), a span carved some other
+    way may be given to slab_bytes_free only if it is at least this long
+*/
+size_t slab_bytes_size (const size_t size);
+
+/*
+    Bytes from the free list of the class of size or a fresh carve, NULL on
+    alloc failure. Spans above SLAB_MAX_BLOCK have no class
+*/
+void*  slab_bytes_alloc(tslab_t * const slab, const allocator_t * const allocator, const size_t size);
+void   slab_bytes_free (tslab_t * const slab, void * const ptr, const size_t size);
+
+void* slab_record_alloc(tslab_t * const slab, const allocator_t * const allocator);
+void  slab_record_free (tslab_t * const slab, void * const record);
+
+/*
+    Drop every block at once, the slab stays usable
+*/
+void  slab_clear(tslab_t * const slab, const allocator_t * const allocator);
+
+#endif
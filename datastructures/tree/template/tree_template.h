@@ -0,0 +1,273 @@
+#ifndef TREE_TEMPLATE_H
+#define TREE_TEMPLATE_H
+
+#include "../../../libs/logging/logging.h"
+#include "../../../libs/alloc/alloc.h"
+#include "../../../libs/types.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+    Compile-time specialized AVL map. DEFINE_TREE(name, key_t, value_t, cmp)
+    generates name_t, name_node_t and static inline name_ctor, name_dtor,
+    name_insert (insert or assign), name_find, name_delete and name_foreach.
+    Keys and values are stored inline in the node, cmp(a, b) is expanded
+    in place and must return <0, 0 or >0 (TREE_CMP_NUM fits integer keys)
+*/
+
+#define TREE_CMP_NUM(a, b) (((a) > (b)) - ((a) < (b)))
+
+#define TREE_TEMPLATE_MAX_HEIGHT 96
+
+#define DEFINE_TREE(name, key_t, value_t, cmp)                                            \
+                                                                                          \
+typedef struct name##_node_t                                                              \
+{                                                                                         \
+    key_t                 key;                                                            \
+    value_t               value;                                                          \
+    struct name##_node_t* left;                                                           \
+    struct name##_node_t* right;                                                          \
+    int                   height;                                                         \
+} name##_node_t;                                                                          \
+                                                                                          \
+typedef struct                                                                            \
+{                                                                                         \
+    size_t             nodes_amount;                                                      \
+    name##_node_t*     root;                                                              \
+    const allocator_t* allocator;                                                         \
+} name##_t;                                                                               \
+                                                                                          \
+typedef err_t (*name##_visit_t)(const key_t * const key, value_t * const value,           \
+                                void * const ctx);                                        \
+                                                                                          \
+static inline int name##_height_of(const name##_node_t* node)                             \
+{                                                                                         \
+    return node ? node->height : 0;                                                       \
+}                                                                                         \
+                                                                                          \
+static inline void name##_update(name##_node_t* node)                                     \
+{                                                                                         \
+    const int hl = name##_height_of(node->left);                                          \
+    const int hr = name##_height_of(node->right);                                         \
+    node->height = 1 + (hl > hr ? hl : hr);                                               \
+}                                                                                         \
+                                                                                          \
+static inline void name##_rotate_left(name##_node_t** link)                               \
+{                                                                                         \
+    name##_node_t* x = *link;                                                             \
+    name##_node_t* y = x->right;                                                          \
+    x->right = y->left;                                                                   \
+    y->left  = x;                                                                         \
+    name##_update(x);                                                                     \
+    name##_update(y);                                                                     \
+    *link = y;                                                                            \
+}                                                                                         \
+                                                                                          \
+static inline void name##_rotate_right(name##_node_t** link)                              \
+{                                                                                         \
+    name##_node_t* x = *link;                                                             \
+    name##_node_t* y = x->left;                                                           \
+    x->left  = y->right;                                                                  \
+    y->right = x;                                                                         \
+    name##_update(x);                                                                     \
+    name##_update(y);                                                                     \
+    *link = y;                                                                            \
+}                                                                                         \
+                                                                                          \
+static inline void name##_rebalance_path(name##_node_t** path[], size_t depth)            \
+{                                                                                         \
+    while (depth-- > 0)                                                                   \
+    {                                                                                     \
+        name##_node_t** link = path[depth];                                               \
+        name##_node_t*  node = *link;                                                     \
+        const int old_height = node->height;                                              \
+        name##_update(node);                                                              \
+                                                                                          \
+        const int balance = name##_height_of(node->left) - name##_height_of(node->right); \
+        if (balance > 1)                                                                  \
+        {                                                                                 \
+            if (name##_height_of(node->left->left) < name##_height_of(node->left->right)) \
+                name##_rotate_left(&node->left);                                          \
+            name##_rotate_right(link);                                                    \
+        }                                                                                 \
+        else if (balance < -1)                                                            \
+        {                                                                                 \
+            if (name##_height_of(node->right->right) <                                    \
+                name##_height_of(node->right->left))                                      \
+                name##_rotate_right(&node->right);                                        \
+            name##_rotate_left(link);                                                     \
+        }                                                                                 \
+                                                                                          \
+        if ((*link)->height == old_height) break;                                         \
+    }                                                                                     \
+}                                                                                         \
+                                                                                          \
+static inline err_t name##_ctor(name##_t * const tree, const allocator_t * const allocator) \
+{                                                                                         \
+    if (!CHECK(ERROR, tree != NULL, #name "_ctor: tree is NULL")) return ERR_BAD_ARG;     \
+    tree->nodes_amount = 0;                                                               \
+    tree->root         = NULL;                                                            \
+    tree->allocator    = allocator;                                                       \
+    return OK;                                                                            \
+}                                                                                         \
+                                                                                          \
+/* Flattens left spines by rotation while freeing, O(1) extra memory */                   \
+static inline err_t name##_dtor(name##_t * const tree)                                    \
+{                                                                                         \
+    if (!CHECK(ERROR, tree != NULL, #name "_dtor: tree is NULL")) return ERR_BAD_ARG;     \
+                                                                                          \
+    name##_node_t* cur = tree->root;                                                      \
+    while (cur != NULL)                                                                   \
+    {                                                                                     \
+        if (cur->left != NULL)                                                            \
+        {                                                                                 \
+            name##_node_t* left = cur->left;                                              \
+            cur->left   = left->right;                                                    \
+            left->right = cur;                                                            \
+            cur         = left;                                                           \
+            continue;                                                                     \
+        }                                                                                 \
+        name##_node_t* right = cur->right;                                                \
+        mem_free(tree->allocator, cur, sizeof(*cur));                                     \
+        cur = right;                                                                      \
+    }                                                                                     \
+                                                                                          \
+    tree->root         = NULL;                                                            \
+    tree->nodes_amount = 0;                                                               \
+    return OK;                                                                            \
+}                                                                                         \
+                                                                                          \
+static inline err_t name##_insert(name##_t * const tree, const key_t key,                 \
+                                  const value_t value)                                    \
+{                                                                                         \
+    if (!CHECK(ERROR, tree != NULL, #name "_insert: tree is NULL")) return ERR_BAD_ARG;   \
+                                                                                          \
+    name##_node_t** path[TREE_TEMPLATE_MAX_HEIGHT + 1];                                   \
+    size_t          depth = 0;                                                            \
+    name##_node_t** link  = &tree->root;                                                  \
+                                                                                          \
+    while (*link != NULL)                                                                 \
+    {                                                                                     \
+        const int c = cmp(key, (*link)->key);                                             \
+        if (c == 0) { (*link)->value = value; return OK; }                                \
+        if (!CHECK(ERROR, depth < TREE_TEMPLATE_MAX_HEIGHT,                               \
+                   #name "_insert: descent exceeded limit")) return ERR_CORRUPT;          \
+        path[depth++] = link;                                                             \
+        link = (c < 0) ? &(*link)->left : &(*link)->right;                                \
+    }                                                                                     \
+                                                                                          \
+    name##_node_t* node = (name##_node_t*)mem_alloc(tree->allocator, sizeof(*node));      \
+    if (!CHECK(ERROR, node != NULL, #name "_insert: node alloc failed")) return ERR_ALLOC; \
+                                                                                          \
+    node->key    = key;                                                                   \
+    node->value  = value;                                                                 \
+    node->left   = NULL;                                                                  \
+    node->right  = NULL;                                                                  \
+    node->height = 1;                                                                     \
+    *link        = node;                                                                  \
+    tree->nodes_amount += 1;                                                              \
+                                                                                          \
+    name##_rebalance_path(path, depth);                                                   \
+    return OK;                                                                            \
+}                                                                                         \
+                                                                                          \
+static inline err_t name##_find(const name##_t * const tree, const key_t key,             \
+                                value_t * const value)                                    \
+{                                                                                         \
+    const name##_node_t* cur = tree->root;                                                \
+    while (cur != NULL)                                                                   \
+    {                                                                                     \
+        const int c = cmp(key, cur->key);                                                 \
+        if (c == 0)                                                                       \
+        {                                                                                 \
+            if (value) *value = cur->value;                                               \
+            return OK;                                                                    \
+        }                                                                                 \
+        cur = (c < 0) ? cur->left : cur->right;                                           \
+    }                                                                                     \
+    return ERR_NOT_FOUND;                                                                 \
+}                                                                                         \
+                                                                                          \
+static inline err_t name##_delete(name##_t * const tree, const key_t key)                 \
+{                                                                                         \
+    if (!CHECK(ERROR, tree != NULL, #name "_delete: tree is NULL")) return ERR_BAD_ARG;   \
+                                                                                          \
+    name##_node_t** path[TREE_TEMPLATE_MAX_HEIGHT + 1];                                   \
+    size_t          depth = 0;                                                            \
+    name##_node_t** link  = &tree->root;                                                  \
+                                                                                          \
+    while (*link != NULL)                                                                 \
+    {                                                                                     \
+        const int c = cmp(key, (*link)->key);                                             \
+        if (c == 0) break;                                                                \
+        if (!CHECK(ERROR, depth < TREE_TEMPLATE_MAX_HEIGHT,                               \
+                   #name "_delete: descent exceeded limit")) return ERR_CORRUPT;          \
+        path[depth++] = link;                                                             \
+        link = (c < 0) ? &(*link)->left : &(*link)->right;                                \
+    }                                                                                     \
+                                                                                          \
+    name##_node_t* target = *link;                                                        \
+    if (target == NULL) return ERR_NOT_FOUND;                                             \
+                                                                                          \
+    if (target->right == NULL)                                                            \
+    {                                                                                     \
+        *link = target->left;                                                             \
+    } else {                                                                              \
+        const size_t target_depth = depth;                                                \
+        path[depth++] = link;                                                             \
+                                                                                          \
+        name##_node_t** succ_link = &target->right;                                       \
+        while ((*succ_link)->left != NULL)                                                \
+        {                                                                                 \
+            if (!CHECK(ERROR, depth < TREE_TEMPLATE_MAX_HEIGHT,                           \
+                       #name "_delete: descent exceeded limit")) return ERR_CORRUPT;      \
+            path[depth++] = succ_link;                                                    \
+            succ_link = &(*succ_link)->left;                                              \
+        }                                                                                 \
+                                                                                          \
+        name##_node_t* succ = *succ_link;                                                 \
+        *succ_link   = succ->right;                                                       \
+        succ->left   = target->left;                                                      \
+        succ->right  = target->right;                                                     \
+        succ->height = target->height;                                                    \
+        *link        = succ;                                                              \
+        if (depth > target_depth + 1) path[target_depth + 1] = &succ->right;              \
+    }                                                                                     \
+                                                                                          \
+    mem_free(tree->allocator, target, sizeof(*target));                                   \
+    tree->nodes_amount -= 1;                                                              \
+                                                                                          \
+    name##_rebalance_path(path, depth);                                                   \
+    return OK;                                                                            \
+}                                                                                         \
+                                                                                          \
+static inline err_t name##_foreach(const name##_t * const tree, name##_visit_t visit,     \
+                                   void * const ctx)                                      \
+{                                                                                         \
+    if (!CHECK(ERROR, tree != NULL && visit != NULL, #name "_foreach: bad args"))         \
+        return ERR_BAD_ARG;                                                               \
+                                                                                          \
+    name##_node_t* stack[TREE_TEMPLATE_MAX_HEIGHT + 1];                                   \
+    size_t         top = 0;                                                               \
+    name##_node_t* cur = tree->root;                                                      \
+                                                                                          \
+    while (cur != NULL || top > 0)                                                        \
+    {                                                                                     \
+        while (cur != NULL)                                                               \
+        {                                                                                 \
+            if (!CHECK(ERROR, top <= TREE_TEMPLATE_MAX_HEIGHT,                            \
+                       #name "_foreach: tree is too deep")) return ERR_CORRUPT;           \
+            stack[top++] = cur;                                                           \
+            cur = cur->left;                                                              \
+        }                                                                                 \
+        cur = stack[--top];                                                               \
+        const err_t rc = visit(&cur->key, &cur->value, ctx);                              \
+        if (rc != OK) return rc;                                                          \
+        cur = cur->right;                                                                 \
+    }                                                                                     \
+    return OK;                                                                            \
+}
+
+#endif
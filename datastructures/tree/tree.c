@@ -1,31 +1,83 @@
 #include "tree.h"
+#include "iter/iter.h"
+#include "serial/serial.h"
+
+#include <math.h>
+
+#if defined(__GNUC__)
+#define PREFETCH(ptr) __builtin_prefetch((ptr), 0, 3)
+#else
+#define PREFETCH(ptr) ((void)(ptr))
+#endif
+
+#define PREFETCH_CHILDREN(node) \
+    do { PREFETCH((node)->left); PREFETCH((node)->right); } while (0)
 
 err_t node_ctor(node_t * const node)
 {
     if (!CHECK(ERROR, node != NULL, "node_ctor: node is NULL"))
         return ERR_BAD_ARG;
 
-    node->data  = 0;
-    node->left  = NULL;
-    node->right = NULL;
+    node->data.heap = NULL;
+    node->left      = NULL;
+    node->right     = NULL;
+    node->height    = 1;
+    node->is_inline = false;
+    node->key       = (tree_key_t){ 0 };
     return OK;
 }
 
-err_t node_dtor(node_t * node)
+err_t node_dtor(node_t * node, const allocator_t * const allocator)
 {
     if (node == NULL) return ERR_BAD_ARG;
-    if (node->data) free(node->data);
-    free(node);
+    if (!node->is_inline && node->data.heap)
+        mem_free(allocator, node->data.heap, node->key.len + 1);
+    mem_free(allocator, node, sizeof(*node));
+    return OK;
+}
+
+err_t node_set_data(node_t * const node, const char * const data,
+                    const allocator_t * const allocator)
+{
+    if (!CHECK(ERROR, node != NULL, "node_set_data: node is NULL"))
+        return ERR_BAD_ARG;
+
+    tree_key_t key;
+    tree_key_parse(data, &key);
+
+    char* heap = NULL;
+    if (data != NULL && key.len >= TREE_INLINE_KEY)
+    {
+        heap = (char*)mem_alloc(allocator, key.len + 1);
+        if (!CHECK(ERROR, heap != NULL, "node_set_data: data alloc failed"))
+            return ERR_ALLOC;
+        memcpy(heap, data, key.len + 1);
+    }
+
+    if (!node->is_inline && node->data.heap)
+        mem_free(allocator, node->data.heap, node->key.len + 1);
+
+    node->key       = key;
+    node->is_inline = (data != NULL && heap == NULL);
+    if (node->is_inline) memcpy(node->data.small, data, key.len + 1);
+    else                 node->data.heap = heap;
     return OK;
 }
 
 err_t tree_ctor(tree_t * const tree)
+{
+    return tree_ctor_alloc(tree, NULL);
+}
+
+err_t tree_ctor_alloc(tree_t * const tree, const allocator_t * const allocator)
 {
     if (!CHECK(ERROR, tree != NULL, "tree_ctor: tree is NULL"))
         return ERR_BAD_ARG;
 
     tree->nodes_amount = 0;
-    tree->root = NULL;
+    tree->root         = NULL;
+    tree->allocator    = allocator;
+    slab_init(&tree->slab, sizeof(node_t));
     return OK;
 }
 
@@ -34,145 +86,797 @@ err_t tree_dtor(tree_t * const tree)
     if (!CHECK(ERROR, tree != NULL, "tree_dtor: tree is NULL"))
         return ERR_BAD_ARG;
 
-    (void)tree_clear(tree);
-    tree->root = NULL;
-    tree->nodes_amount = 0;
+    return tree_clear(tree);
+}
+
+typedef struct
+{
+    const node_t* node;
+    const node_t* lo;
+    const node_t* hi;
+    size_t        depth;
+} verify_frame_t;
+
+static inline size_t visit_slot(const node_t * const node, const size_t mask)
+{
+    return (size_t)(((uint64_t)(uintptr_t)node >> 4) * 0x9E3779B97F4A7C15ull >> 20) & mask;
+}
+
+// Open addressing over node addresses, false when node was already there
+static bool visit_once(uintptr_t * const set, const size_t mask, const node_t * const node)
+{
+    const uintptr_t key  = (uintptr_t)node;
+    size_t          slot = visit_slot(node, mask);
+
+    while (set[slot] != 0)
+    {
+        if (set[slot] == key) return false;
+        slot = (slot + 1) & mask;
+    }
+    set[slot] = key;
+    return true;
+}
+
+static err_t verify_walk(const tree_t * const tree, uintptr_t * const set, const size_t mask,
+                         tree_verify_report_t * const report)
+{
+    verify_frame_t stack[TREE_MAX_HEIGHT + 2];
+    size_t top = 0;
+    stack[top++] = (verify_frame_t){ tree->root, NULL, NULL, 0 };
+
+    while (top > 0)
+    {
+        const verify_frame_t f    = stack[--top];
+        const node_t*        node = f.node;
+
+        // Past nodes_amount the set would fill up: stop before probing it
+        if (!CHECK(ERROR, report->nodes < tree->nodes_amount,
+                   "tree_verify: more nodes reachable than nodes_amount=%zu", tree->nodes_amount) ||
+            !CHECK(ERROR, visit_once(set, mask, node),
+                   "tree_verify: node %p reached twice (cycle or shared child)", (void*)node))
+            return ERR_CORRUPT;
+
+        const int hl = node->left  ? node->left->height  : 0;
+        const int hr = node->right ? node->right->height : 0;
+        if (!CHECK(ERROR, node->height == 1 + (hl > hr ? hl : hr) && hl - hr <= 1 && hr - hl <= 1,
+                   "tree_verify: node %p height %d with children %d/%d", (void*)node, node->height, hl, hr))
+            return ERR_CORRUPT;
+
+        if (!CHECK(ERROR, (f.lo == NULL || tree_key_compare(&f.lo->key, node_data(f.lo), &node->key, node_data(node)) <= 0) &&
+                          (f.hi == NULL || tree_key_compare(&node->key, node_data(node), &f.hi->key, node_data(f.hi)) <= 0),
+                   "tree_verify: node %p is out of order", (void*)node))
+            return ERR_CORRUPT;
+
+        report->nodes       += 1;
+        report->depth_sum   += f.depth;
+        report->leaves      += (node->left == NULL && node->right == NULL);
+        report->left_heavy  += (hl > hr);
+        report->right_heavy += (hr > hl);
+
+        // Stored heights are checked, so depth tracks them and the stack can not overflow
+        if (node->right)
+        {
+            PREFETCH(&set[visit_slot(node->right, mask)]);
+            stack[top++] = (verify_frame_t){ node->right, node, f.hi, f.depth + 1 };
+        }
+        if (node->left)
+        {
+            PREFETCH(&set[visit_slot(node->left, mask)]);
+            stack[top++] = (verify_frame_t){ node->left, f.lo, node, f.depth + 1 };
+        }
+    }
+
+    if (!CHECK(ERROR, report->nodes == tree->nodes_amount,
+               "tree_verify: %zu nodes reachable, nodes_amount=%zu", report->nodes, tree->nodes_amount))
+        return ERR_CORRUPT;
     return OK;
 }
 
 err_t tree_verify(const tree_t * const tree)
+{
+    return tree_verify_report(tree, NULL);
+}
+
+err_t tree_verify_report(const tree_t * const tree, tree_verify_report_t * const report)
 {
     if (!CHECK(ERROR, tree != NULL, "tree_verify: tree is NULL"))
         return ERR_BAD_ARG;
 
-    if (!CHECK(ERROR,
-               !(tree->nodes_amount > 0 && tree->root == NULL),
-               "tree_verify: nodes_amount=%zu but root is NULL",
-               (size_t)tree->nodes_amount))
+    tree_verify_report_t local = { 0 };
+    if (tree->root == NULL)
+    {
+        if (!CHECK(ERROR, tree->nodes_amount == 0,
+                   "tree_verify: nodes_amount=%zu but root is NULL", (size_t)tree->nodes_amount))
+            return ERR_CORRUPT;
+        if (report) *report = local;
+        return OK;
+    }
+
+    if (!CHECK(ERROR, tree->root->height > 0 && tree->root->height <= TREE_MAX_HEIGHT,
+               "tree_verify: root height %d", tree->root->height))
         return ERR_CORRUPT;
 
-    return OK;
+    // Load factor stays at or below one half
+    size_t capacity = 16;
+    while (capacity < 2 * tree->nodes_amount) capacity *= 2;
+
+    uintptr_t* set = (uintptr_t*)mem_calloc(tree->allocator, capacity, sizeof(uintptr_t));
+    if (!CHECK(ERROR, set != NULL, "tree_verify: visited set alloc failed (%zu)", capacity))
+        return ERR_ALLOC;
+
+    const err_t rc = verify_walk(tree, set, capacity - 1, &local);
+    mem_free(tree->allocator, set, capacity * sizeof(uintptr_t));
+
+    local.height = tree->root->height;
+    if (rc == OK && report) *report = local;
+    return rc;
 }
 
-err_t tree_print_node(const node_t * const node, size_t iter)
+err_t tree_stats(const tree_t * const tree, tree_stats_t * const out)
 {
-    if (!CHECK(ERROR, node != NULL, "tree_print_node: node is NULL"))
+    if (!CHECK(ERROR, tree != NULL && out != NULL, "tree_stats: bad args"))
         return ERR_BAD_ARG;
 
-    if (!CHECK(ERROR, iter <= MAX_RECURSION_LIMIT,
-               "tree_print_node: recursion limit exceeded (%zu > %zu)",
-               iter, (size_t)MAX_RECURSION_LIMIT))
-        return ERR_CORRUPT;
+    memset(out, 0, sizeof(*out));
+    out->counters = tree->counters;
+
+    tree_iter_t it;
+    const err_t rc = tree_iter_begin(&it, tree, TREE_PREORDER);
+    if (rc != OK) return rc;
 
-    iter += 1;
+    size_t        depth_sum = 0;
+    const node_t* node      = NULL;
+    while ((node = tree_iter_next(&it)) != NULL)
+    {
+        if (!CHECK(ERROR, it.depth < TREE_MAX_HEIGHT, "tree_stats: depth %zu", it.depth))
+        {
+            tree_iter_end(&it);
+            return ERR_CORRUPT;
+        }
 
-    printf("(");
-    if (node->left != NULL)
-        (void)tree_print_node(node->left, iter);
-    printf("\"%s\"", node->data);
-    if (node->right != NULL)
-        (void)tree_print_node(node->right, iter);
-    printf(")");
+        out->nodes += 1;
+        out->depth_histogram[it.depth] += 1;
+        depth_sum += it.depth;
+        if ((int)it.depth >= out->height) out->height = (int)it.depth + 1;
 
+        if (node->left == NULL && node->right == NULL) out->leaves       += 1;
+        else if (node->left == NULL || node->right == NULL) out->single_child += 1;
+
+        out->key_bytes += node->key.len;
+        if (node->is_inline) out->inline_keys += 1;
+        else if (node->data.heap) out->heap_key_bytes += node->key.len + 1;
+    }
+    const err_t status = it.status;
+    tree_iter_end(&it);
+    if (status != OK) return status;
+
+    out->node_bytes   = out->nodes * sizeof(node_t);
+    out->slab_bytes   = tree->slab.bytes_reserved;
+    const size_t used = out->node_bytes + out->heap_key_bytes;
+    out->overhead_bytes = (out->slab_bytes > used) ? out->slab_bytes - used : 0;
+
+    for (void* record = tree->slab.free_records; record != NULL; out->free_records++)
+        memcpy(&record, record, sizeof(void*));
+
+    if (out->nodes > 0)
+    {
+        out->height_ratio = out->height / log2((double)out->nodes + 1);
+        out->fill         = out->nodes / (ldexp(1.0, out->height) - 1);
+        out->mean_depth   = (double)depth_sum / out->nodes;
+    }
     return OK;
 }
 
+err_t tree_print_node(const node_t * const node)
+{
+    if (!CHECK(ERROR, node != NULL, "tree_print_node: node is NULL"))
+        return ERR_BAD_ARG;
+
+    char buffer[4096];
+    tree_sink_t sink;
+    tree_sink_file(&sink, stdout, buffer, sizeof(buffer));
+    return tree_write_node(node, &sink, TREE_FORMAT_TEXT, NULL);
+}
+
 err_t tree_print(const tree_t * const tree)
 {
     if (!CHECK(ERROR, tree != NULL, "tree_print: tree is NULL"))
         return ERR_BAD_ARG;
 
-    return tree_print_node(tree->root, 0);
+    return tree_print_node(tree->root);
+}
+
+// Return node and its key bytes to the tree slab
+static void node_release(tree_t * const tree, node_t * const node)
+{
+    TREE_STAT(tree, key_bytes, 0 - node->key.len);
+    if (!node->is_inline && node->data.heap)
+    {
+        TREE_STAT(tree, heap_key_bytes, 0 - (node->key.len + 1));
+        slab_bytes_free(&tree->slab, node->data.heap, node->key.len + 1);
+    }
+    slab_record_free(&tree->slab, node);
+}
+
+err_t tree_delete_node(tree_t * const tree, node_t * node)
+{
+    if (!CHECK(ERROR, tree != NULL && node != NULL, "tree_delete_node: bad args"))
+        return ERR_BAD_ARG;
+
+    tree_iter_t it;
+    (void)tree_iter_begin_node(&it, node, tree->allocator, TREE_POSTORDER);
+
+    node_t* cur = NULL;
+    while ((cur = tree_iter_next(&it)) != NULL)
+    {
+        node_release(tree, cur);
+        tree->nodes_amount -= 1;
+        TREE_STAT(tree, deletes, 1);
+    }
+
+    const err_t status = it.status;
+    tree_iter_end(&it);
+    return status;
 }
 
-err_t tree_delete_node(node_t * node, size_t iter)
+err_t tree_clear(tree_t * const tree)
 {
-    if (!CHECK(ERROR, node != NULL, "tree_delete_node: node is NULL"))
+    if (!CHECK(ERROR, tree != NULL, "tree_clear: tree is NULL"))
         return ERR_BAD_ARG;
 
-    if (!CHECK(ERROR, iter <= MAX_RECURSION_LIMIT,
-               "tree_delete_node: recursion limit exceeded (%zu > %zu)",
-               iter, (size_t)MAX_RECURSION_LIMIT))
-        return ERR_CORRUPT;
+    slab_clear(&tree->slab, tree->allocator);
+    tree->root         = NULL;
+    tree->nodes_amount = 0;
 
-    iter += 1;
+    tree->counters.key_bytes      = 0;
+    tree->counters.heap_key_bytes = 0;
+    return OK;
+}
 
-    if (node->left  != NULL)
-        if (!CHECK(ERROR, tree_delete_node(node->left,  iter) == OK,
-                   "tree_delete_node: failed to delete left subtree"))
-            return ERR_CORRUPT;
+void tree_key_parse(const char * const str, tree_key_t * const key)
+{
+    tree_key_parse_n(str, str ? strlen(str) : 0, key);
+}
+
+void tree_key_parse_n(const char * const str, const size_t len, tree_key_t * const key)
+{
+    *key = (tree_key_t){ 0 };
+    if (str == NULL) return;
+
+    const char* p    = str;
+    const char* last = str + len;
+    while (p < last && isspace((unsigned char)*p)) p++;
+
+    const bool negative = (p < last && *p == '-');
+    if (p < last && (*p == '-' || *p == '+')) p++;
+
+    uint64_t value = 0;
+    const uint64_t limit = negative ? (uint64_t)INT64_MAX + 1 : (uint64_t)INT64_MAX;
+    for (; p < last && *p >= '0' && *p <= '9'; ++p)
+    {
+        const uint64_t digit = (uint64_t)(*p - '0');
+        value = (value > (limit - digit) / 10) ? limit : value * 10 + digit;
+    }
+    key->num = negative ? (int64_t)(0 - value) : (int64_t)value;
+
+    for (size_t i = 0; i < len && i < sizeof(key->prefix); ++i)
+        key->prefix |= (uint64_t)(unsigned char)str[i] << (56 - 8 * i);
+    key->len = len;
+}
+
+int tree_key_cmp(const char * const a, const char * const b)
+{
+    tree_key_t ka, kb;
+    tree_key_parse(a, &ka);
+    tree_key_parse(b, &kb);
+    return tree_key_compare(&ka, a, &kb, b);
+}
+
+static inline int node_height(const node_t* node)
+{
+    return node ? node->height : 0;
+}
+
+static inline void node_update(node_t* node)
+{
+    const int hl = node_height(node->left);
+    const int hr = node_height(node->right);
+    node->height = 1 + (hl > hr ? hl : hr);
+}
+
+static void rotate_left(node_t** link)
+{
+    node_t* x = *link;
+    node_t* y = x->right;
+    x->right  = y->left;
+    y->left   = x;
+    node_update(x);
+    node_update(y);
+    *link = y;
+}
+
+static void rotate_right(node_t** link)
+{
+    node_t* x = *link;
+    node_t* y = x->left;
+    x->left   = y->right;
+    y->right  = x;
+    node_update(x);
+    node_update(y);
+    *link = y;
+}
+
+static void rebalance(node_t** link)
+{
+    node_t* node = *link;
+    node_update(node);
+
+    const int balance = node_height(node->left) - node_height(node->right);
+    if (balance > 1)
+    {
+        if (node_height(node->left->left) < node_height(node->left->right))
+            rotate_left(&node->left);
+        rotate_right(link);
+    }
+    else if (balance < -1)
+    {
+        if (node_height(node->right->right) < node_height(node->right->left))
+            rotate_right(&node->right);
+        rotate_left(link);
+    }
+}
+
+// Walk links bottom-up, ancestors can't change once a subtree keeps its height
+static void rebalance_path(node_t** path[], size_t depth)
+{
+    while (depth-- > 0)
+    {
+        const int old_height = (*path[depth])->height;
+        rebalance(path[depth]);
+        if ((*path[depth])->height == old_height) break;
+    }
+}
+
+node_t* tree_node_new(tree_t * const tree, const char * const data, const tree_key_t * const key)
+{
+    node_t *node = (node_t*)slab_record_alloc(&tree->slab, tree->allocator);
+    if (!CHECK(ERROR, node != NULL, "tree_node_new: node alloc failed"))
+        return NULL;
+
+    memset(node, 0, sizeof(*node));
+    if (data != NULL && key->len < TREE_INLINE_KEY) {
+        memcpy(node->data.small, data, key->len);
+        node->data.small[key->len] = '\0';
+        node->is_inline = true;
+    } else if (data != NULL) {
+        char *copy = (char*)slab_bytes_alloc(&tree->slab, tree->allocator, key->len + 1);
+        if (!CHECK(ERROR, copy != NULL, "tree_node_new: data alloc failed")) {
+            slab_record_free(&tree->slab, node);
+            return NULL;
+        }
+        memcpy(copy, data, key->len);
+        copy[key->len] = '\0';
+        node->data.heap = copy;
+        TREE_STAT(tree, heap_key_bytes, key->len + 1);
+    }
+    TREE_STAT(tree, key_bytes, key->len);
+
+    node->height = 1;
+    node->key    = *key;
+    return node;
+}
+
+err_t tree_insert(tree_t * const tree, const tree_elem_t data)
+{
+    if (!CHECK(ERROR, tree != NULL, "tree_insert: tree is NULL"))
+        return ERR_BAD_ARG;
+
+    tree_key_t key;
+    tree_key_parse(data, &key);
+
+    node_t** path[TREE_MAX_HEIGHT + 1];
+    size_t   depth = 0;
+    node_t** link  = &tree->root;
 
-    if (node->right != NULL)
-        if (!CHECK(ERROR, tree_delete_node(node->right, iter) == OK,
-                   "tree_delete_node: failed to delete right subtree"))
+    while (*link != NULL)
+    {
+        if (!CHECK(ERROR, depth < TREE_MAX_HEIGHT, "tree_insert: descent exceeded limit"))
             return ERR_CORRUPT;
 
-    (void)node_dtor(node);
+        path[depth++] = link;
+        link = (tree_key_compare(&(*link)->key, node_data(*link), &key, data) > 0) ? &(*link)->left : &(*link)->right;
+    }
+
+    node_t *node = tree_node_new(tree, data, &key);
+    if (node == NULL) return ERR_ALLOC;
+
+    *link = node;
+    tree->nodes_amount += 1;
+    TREE_STAT(tree, inserts, 1);
+
+    rebalance_path(path, depth);
     return OK;
 }
 
-err_t tree_clear(const tree_t * const tree)
+err_t tree_find(const tree_t * const tree, const char * const key, node_t ** const found)
 {
-    if (!CHECK(ERROR, tree != NULL, "tree_clear: tree is NULL"))
+    if (!CHECK(ERROR, tree != NULL && found != NULL, "tree_find: bad args"))
         return ERR_BAD_ARG;
 
-    if (tree->root == NULL)
-        return OK;
+    tree_key_t k;
+    tree_key_parse(key, &k);
 
-    if (!CHECK(ERROR, tree_delete_node(tree->root, 0) == OK,
-               "tree_clear: failed to delete nodes"))
-        return ERR_CORRUPT;
+    node_t* cur = tree->root;
+    while (cur != NULL)
+    {
+        PREFETCH_CHILDREN(cur);
+        const int cmp = tree_key_compare(&k, key, &cur->key, node_data(cur));
+        if (cmp == 0) break;
+        cur = (cmp < 0) ? cur->left : cur->right;
+    }
+
+    *found = cur;
+    return cur ? OK : ERR_NOT_FOUND;
+}
+
+// One lookup in flight of tree_find_batch
+typedef struct
+{
+    const node_t* cur;
+    const char*   str;
+    tree_key_t    key;
+    size_t        index;
+} find_lane_t;
+
+// Lookups kept in flight, enough to cover the line fill buffers of one core
+#define FIND_BATCH_LANES 16
 
+static void find_lane_start(find_lane_t * const lane, const tree_t * const tree,
+                            const char * const key, const size_t index)
+{
+    lane->cur   = tree->root;
+    lane->str   = key;
+    lane->index = index;
+    tree_key_parse(key, &lane->key);
+}
+
+err_t tree_find_batch(const tree_t * const tree, const char * const * const keys,
+                      const size_t n, node_t ** const out)
+{
+    if (!CHECK(ERROR, tree != NULL && ((keys != NULL && out != NULL) || n == 0),
+               "tree_find_batch: bad args"))
+        return ERR_BAD_ARG;
+
+    find_lane_t lanes[FIND_BATCH_LANES];
+    size_t      active = 0;
+    size_t      issued = 0;
+    for (; active < FIND_BATCH_LANES && issued < n; ++active, ++issued)
+        find_lane_start(&lanes[active], tree, keys[issued], issued);
+
+    // Every lane makes one step per round, the child it moves to is prefetched
+    // and is not touched again before the other lanes had their step
+    while (active > 0)
+    {
+        for (size_t l = 0; l < active; )
+        {
+            find_lane_t*  lane = &lanes[l];
+            const node_t* cur  = lane->cur;
+
+            int cmp = 0;
+            if (cur != NULL)
+            {
+                cmp = tree_key_compare(&lane->key, lane->str, &cur->key, node_data(cur));
+                if (cmp != 0)
+                {
+                    lane->cur = (cmp < 0) ? cur->left : cur->right;
+                    PREFETCH(lane->cur);
+                    ++l;
+                    continue;
+                }
+            }
+
+            // Finished lane takes the next key or the last lane's place
+            out[lane->index] = (node_t*)cur;
+            if (issued < n) {
+                find_lane_start(lane, tree, keys[issued], issued);
+                ++issued;
+                ++l;
+            } else {
+                *lane = lanes[--active];
+            }
+        }
+    }
     return OK;
 }
 
-err_t tree_insert(tree_t * const tree, const tree_elem_t data)
+// First node whose key is not less than key (strict - greater than key)
+static node_t* bound(const tree_t * const tree, const char * const key, const bool strict)
 {
-    if (!CHECK(ERROR, tree != NULL, "tree_insert: tree is NULL"))
+    tree_key_t k;
+    tree_key_parse(key, &k);
+
+    node_t* result = NULL;
+    node_t* cur    = tree->root;
+    while (cur != NULL)
+    {
+        PREFETCH_CHILDREN(cur);
+        const int cmp = tree_key_compare(&cur->key, node_data(cur), &k, key);
+        if (strict ? cmp > 0 : cmp >= 0) {
+            result = cur;
+            cur    = cur->left;
+        } else {
+            cur    = cur->right;
+        }
+    }
+    return result;
+}
+
+err_t tree_lower_bound(const tree_t * const tree, const char * const key, node_t ** const found)
+{
+    if (!CHECK(ERROR, tree != NULL && found != NULL, "tree_lower_bound: bad args"))
         return ERR_BAD_ARG;
 
-    node_t *node = (node_t*)calloc(1, sizeof(*node));
-    if (!CHECK(ERROR, node != NULL, "tree_insert: node alloc failed"))
-        return ERR_ALLOC;
+    *found = bound(tree, key, false);
+    return *found ? OK : ERR_NOT_FOUND;
+}
 
-    if (data != NULL) {
-        size_t len = strlen(data);
-        char *copy = (char*)calloc(len + 1, 1);
-        if (!CHECK(ERROR, copy != NULL, "tree_insert: data alloc failed")) {
-            free(node);
-            return ERR_ALLOC;
+err_t tree_upper_bound(const tree_t * const tree, const char * const key, node_t ** const found)
+{
+    if (!CHECK(ERROR, tree != NULL && found != NULL, "tree_upper_bound: bad args"))
+        return ERR_BAD_ARG;
+
+    *found = bound(tree, key, true);
+    return *found ? OK : ERR_NOT_FOUND;
+}
+
+err_t tree_range(const tree_t * const tree, const char * const lo, const char * const hi,
+                 tree_visit_t visit, void * const ctx)
+{
+    if (!CHECK(ERROR, tree != NULL && visit != NULL, "tree_range: bad args"))
+        return ERR_BAD_ARG;
+
+    tree_key_t klo, khi;
+    tree_key_parse(lo, &klo);
+    tree_key_parse(hi, &khi);
+
+    // Ancestors still to be visited, innermost on top
+    node_t* stack[TREE_MAX_HEIGHT + 1];
+    size_t  top = 0;
+    node_t* cur = tree->root;
+
+    while (cur != NULL)
+    {
+        PREFETCH_CHILDREN(cur);
+        if (lo == NULL || tree_key_compare(&cur->key, node_data(cur), &klo, lo) >= 0)
+        {
+            if (!CHECK(ERROR, top <= TREE_MAX_HEIGHT, "tree_range: tree is too deep"))
+                return ERR_CORRUPT;
+            stack[top++] = cur;
+            cur = cur->left;
+        } else {
+            cur = cur->right;
         }
-        memcpy(copy, data, len);
-        node->data = copy;
     }
 
-    tree->nodes_amount += 1;
+    while (top > 0)
+    {
+        node_t* node = stack[--top];
+        if (hi != NULL && tree_key_compare(&node->key, node_data(node), &khi, hi) > 0)
+            break;
+
+        // Start fetching the successor spine before handing the node out
+        for (cur = node->right; cur != NULL; cur = cur->left)
+        {
+            if (!CHECK(ERROR, top <= TREE_MAX_HEIGHT, "tree_range: tree is too deep"))
+                return ERR_CORRUPT;
+            PREFETCH_CHILDREN(cur);
+            stack[top++] = cur;
+        }
 
-    if (tree->root == NULL) {
-        tree->root = node;
-        return OK;
+        const err_t rc = visit(node, ctx);
+        if (rc != OK) return rc;
     }
 
-    node_t *cur = tree->root;
-    size_t  i   = 0;
+    return OK;
+}
+
+err_t tree_delete(tree_t * const tree, const char * const key)
+{
+    if (!CHECK(ERROR, tree != NULL, "tree_delete: tree is NULL"))
+        return ERR_BAD_ARG;
+
+    tree_key_t k;
+    tree_key_parse(key, &k);
 
-    for (; i < MAX_RECURSION_LIMIT; ++i) {
-        if (cur->left == NULL)  { cur->left  = node; break; }
-        if (cur->right == NULL) { cur->right = node; break; }
+    node_t** path[TREE_MAX_HEIGHT + 1];
+    size_t   depth = 0;
+    node_t** link  = &tree->root;
 
-        int c = atoi(cur->data ? cur->data : "0");
-        int d = atoi(node->data ? node->data : "0");
-        cur = (c >= d) ? cur->left : cur->right;
+    while (*link != NULL)
+    {
+        const int cmp = tree_key_compare(&k, key, &(*link)->key, node_data(*link));
+        if (cmp == 0) break;
+
+        if (!CHECK(ERROR, depth < TREE_MAX_HEIGHT, "tree_delete: descent exceeded limit"))
+            return ERR_CORRUPT;
+
+        path[depth++] = link;
+        link = (cmp < 0) ? &(*link)->left : &(*link)->right;
     }
 
-    if (!CHECK(ERROR, i < MAX_RECURSION_LIMIT,
-               "tree_insert: descent exceeded limit")) {
-        free(node->data);
-        free(node);
-        tree->nodes_amount -= 1;
-        return ERR_CORRUPT;
+    node_t* target = *link;
+    if (target == NULL) return ERR_NOT_FOUND;
+
+    if (target->right == NULL)
+    {
+        *link = target->left;
+    } else {
+        const size_t target_depth = depth;
+        path[depth++] = link;
+
+        node_t** succ_link = &target->right;
+        while ((*succ_link)->left != NULL)
+        {
+            if (!CHECK(ERROR, depth < TREE_MAX_HEIGHT, "tree_delete: descent exceeded limit"))
+                return ERR_CORRUPT;
+
+            path[depth++] = succ_link;
+            succ_link = &(*succ_link)->left;
+        }
+
+        node_t* succ = *succ_link;
+        *succ_link   = succ->right;
+        succ->left   = target->left;
+        succ->right  = target->right;
+        succ->height = target->height;
+        *link        = succ;
+
+        // The link below the target now hangs off the successor
+        if (depth > target_depth + 1) path[target_depth + 1] = &succ->right;
     }
 
+    node_release(tree, target);
+    tree->nodes_amount -= 1;
+    TREE_STAT(tree, deletes, 1);
+
+    rebalance_path(path, depth);
     return OK;
 }
 
+err_t tree_foreach(const tree_t * const tree, tree_visit_t visit, void * const ctx)
+{
+    if (!CHECK(ERROR, tree != NULL && visit != NULL, "tree_foreach: bad args"))
+        return ERR_BAD_ARG;
+
+    tree_iter_t it;
+    (void)tree_iter_begin(&it, tree, TREE_INORDER);
+
+    err_t   rc  = OK;
+    node_t* cur = NULL;
+    while (rc == OK && (cur = tree_iter_next(&it)) != NULL)
+        rc = visit(cur, ctx);
+
+    if (rc == OK) rc = it.status;
+    tree_iter_end(&it);
+    return rc;
+}
+
+typedef struct
+{
+    tree_key_t  key;
+    const char* str;
+} key_item_t;
+
+static int key_item_cmp(const void* a, const void* b)
+{
+    const key_item_t* x = (const key_item_t*)a;
+    const key_item_t* y = (const key_item_t*)b;
+    return tree_key_compare(&x->key, x->str, &y->key, y->str);
+}
+
+typedef struct
+{
+    size_t   lo;
+    size_t   hi;
+    node_t** link;
+} build_frame_t;
+
+static inline int range_height(size_t size)
+{
+    int height = 0;
+    for (; size > 0; size >>= 1) height++;
+    return height;
+}
+
+err_t tree_build_from_array(tree_t * const tree, const char * const * const keys, const size_t n)
+{
+    if (!CHECK(ERROR, tree != NULL && (keys != NULL || n == 0), "tree_build_from_array: bad args"))
+        return ERR_BAD_ARG;
+
+    if (n == 0) return tree_clear(tree);
+
+    const allocator_t* a = tree->allocator;
+
+    key_item_t* items = (key_item_t*)mem_calloc(a, n, sizeof(*items));
+    if (!CHECK(ERROR, items != NULL, "tree_build_from_array: items alloc failed (%zu)", n))
+        return ERR_ALLOC;
+
+    bool   sorted    = true;
+    size_t key_bytes = 0;
+    for (size_t i = 0; i < n; ++i)
+    {
+        items[i].str = keys[i];
+        tree_key_parse(keys[i], &items[i].key);
+        if (keys[i] != NULL && items[i].key.len >= TREE_INLINE_KEY)
+            key_bytes += slab_bytes_size(items[i].key.len + 1);
+        if (i > 0 && key_item_cmp(&items[i - 1], &items[i]) > 0)
+            sorted = false;
+    }
+
+    if (!sorted) qsort(items, n, sizeof(*items), key_item_cmp);
+
+    // A fresh slab replaces the old one only once everything is carved.
+    // One carve for all nodes in key order and one for all long keys, each
+    // key padded to its byte class so that releasing it feeds the free lists
+    tslab_t slab;
+    slab_init_aligned(&slab, tree->slab.record_size, tree->slab.record_align);
+
+    node_t* block = (node_t*)slab_carve(&slab, a, n * sizeof(node_t), sizeof(void*));
+    char*   bytes = (block && key_bytes) ? (char*)slab_carve(&slab, a, key_bytes, 1) : NULL;
+    if (!CHECK(ERROR, block != NULL && (key_bytes == 0 || bytes != NULL),
+               "tree_build_from_array: node block alloc failed (%zu nodes)", n))
+    {
+        mem_free(a, items, n * sizeof(*items));
+        slab_clear(&slab, a);
+        return ERR_ALLOC;
+    }
+
+    (void)tree_clear(tree);
+    tree->slab = slab;
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        node_t* node = &block[i];
+        memset(node, 0, sizeof(*node));
+        node->key = items[i].key;
+        if (items[i].str == NULL) continue;
+        TREE_STAT(tree, key_bytes, items[i].key.len);
+
+        if (items[i].key.len < TREE_INLINE_KEY) {
+            memcpy(node->data.small, items[i].str, items[i].key.len + 1);
+            node->is_inline = true;
+        } else {
+            memcpy(bytes, items[i].str, items[i].key.len + 1);
+            node->data.heap = bytes;
+            bytes += slab_bytes_size(items[i].key.len + 1);
+            TREE_STAT(tree, heap_key_bytes, items[i].key.len + 1);
+        }
+    }
+    mem_free(a, items, n * sizeof(*items));
+
+    // Middle of every range becomes its root, both halves differ by at most one
+    build_frame_t stack[TREE_MAX_HEIGHT + 2];
+    size_t top = 0;
+    stack[top++] = (build_frame_t){ 0, n, &tree->root };
+
+    while (top > 0)
+    {
+        const size_t lo   = stack[top - 1].lo;
+        const size_t hi   = stack[top - 1].hi;
+        node_t**     link = stack[--top].link;
+
+        if (lo == hi) { *link = NULL; continue; }
+
+        const size_t mid  = lo + (hi - lo) / 2;
+        node_t*      node = &block[mid];
+        node->height = range_height(hi - lo);
+        *link        = node;
+
+        stack[top++] = (build_frame_t){ mid + 1, hi,  &node->right };
+        stack[top++] = (build_frame_t){ lo,      mid, &node->left  };
+    }
+
+    tree->nodes_amount = n;
+    TREE_STAT(tree, inserts, n);
+    return OK;
+}
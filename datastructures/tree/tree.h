@@ -2,30 +2,90 @@
 #define TREE_H
 
 #include "../../libs/logging/logging.h"
+#include "../../libs/alloc/alloc.h"
 #include "../../libs/types.h"
 
+#include "slab/slab.h"
+
 #include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
 #include <limits.h>
+#include <ctype.h>
+#include <stdbool.h>
 
-#define MAX_RECURSION_LIMIT 4096
+// AVL height never exceeds 1.44 * log2(n + 2), 96 levels cover any address space
+#define TREE_MAX_HEIGHT 96
 
 typedef char* tree_elem_t;
 
+/*
+    Key parsed once at insert: decimal value (as atoi reads it, saturated),
+    first 8 bytes packed big-endian and the length. Comparisons only touch
+    the string when both value and prefix tie on long keys
+*/
+typedef struct
+{
+    int64_t  num;
+    uint64_t prefix;
+    size_t   len;
+} tree_key_t;
+
+// Keys shorter than this many bytes are stored inside the node
+#define TREE_INLINE_KEY 24
+
+// node_t.flags: copied by the current path-copying update, not yet published
+#define NODE_FRESH 0x1
+
 typedef struct node_t
 {
-    tree_elem_t    data;
+    union
+    {
+        char* heap;
+        char  small[TREE_INLINE_KEY];
+    } data;
     struct node_t* left;
     struct node_t* right;
+    int            height;
+    bool           is_inline;
+    uint8_t        flags;
+    tree_key_t     key;
 } node_t;
 
+/*
+    Running counters, only updated when built with -D __TREE_STATS__
+*/
+typedef struct
+{
+    size_t inserts;
+    size_t deletes;
+    size_t key_bytes;      // key lengths of live nodes
+    size_t heap_key_bytes; // slab bytes of keys stored outside the nodes
+} tree_counters_t;
+
+#ifdef __TREE_STATS__
+    #define TREE_STAT(tree, field, amount) ((tree)->counters.field += (amount))
+#else
+    #define TREE_STAT(tree, field, amount) ((void)0)
+#endif
+
+/*
+    Nodes and key bytes of a tree live in its slab, blocks come from the
+    allocator and are dropped all at once by tree_clear. Released nodes and
+    long keys go to the slab free lists for later inserts, a slab that has
+    outgrown the tree after heavy churn is compacted by tree_linearize
+*/
 typedef struct
 {
     size_t  nodes_amount;
     node_t* root;
+
+    const allocator_t* allocator;
+    tslab_t            slab;
+
+    tree_counters_t    counters;
 } tree_t;
 
 #define CREATE_TREE(tree_name) \
@@ -36,20 +96,142 @@ typedef struct
     node_t* node_name = calloc(1, sizeof(node_t));  \
     node_ctor((node_name))
 
+static inline const char* node_data(const node_t * const node)
+{
+    return node->is_inline ? node->data.small : node->data.heap;
+}
+
 err_t node_ctor(node_t * const node);
-err_t node_dtor(node_t * node);
+err_t node_dtor(node_t * node, const allocator_t * const allocator);
+
+/*
+    Set key of a standalone node, long keys are copied through allocator
+*/
+err_t node_set_data(node_t * const node, const char * const data,
+                    const allocator_t * const allocator);
 
-err_t tree_ctor(tree_t * const tree);
+err_t tree_ctor      (tree_t * const tree);
+err_t tree_ctor_alloc(tree_t * const tree, const allocator_t * const allocator);
 err_t tree_dtor(tree_t * const tree);
 
-err_t tree_verify(const tree_t * const tree);
+/*
+    Shape figures gathered by a successful tree_verify_report, heavy nodes
+    are those whose subtree heights differ by one
+*/
+typedef struct
+{
+    size_t nodes;
+    size_t leaves;
+    size_t left_heavy;
+    size_t right_heavy;
+    size_t depth_sum;
+    int    height;
+} tree_verify_report_t;
+
+/*
+    Iterative O(n) check of node count, key order, stored heights, AVL
+    balance and of cycles or shared children, the visited-pointer set takes
+    2 to 4 pointers per node for the call. report may be NULL
+*/
+err_t tree_verify       (const tree_t * const tree);
+err_t tree_verify_report(const tree_t * const tree, tree_verify_report_t * const report);
+
+/*
+    Shape and memory of a tree from one pass, bytes are split into nodes,
+    long keys and what the slab holds beyond them (free records, block tails,
+    released key bytes and the padding of long keys to their byte class)
+*/
+typedef struct
+{
+    size_t          nodes;
+    int             height;
+    double          height_ratio;   // height / log2(nodes + 1): 1 is perfect, AVL stays under 1.45
+    double          fill;           // nodes / (2^height - 1)
+    double          mean_depth;
+    size_t          depth_histogram[TREE_MAX_HEIGHT]; // nodes per depth, root at 0
+
+    size_t          leaves;
+    size_t          single_child;
 
-err_t tree_print_node(const node_t * const node, size_t iter);
+    size_t          inline_keys;
+    size_t          key_bytes;      // lengths of all keys
+    size_t          node_bytes;     // nodes * sizeof(node_t), inline keys included
+    size_t          heap_key_bytes; // long keys with terminators
+    size_t          slab_bytes;     // reserved from the allocator
+    size_t          overhead_bytes; // slab_bytes - node_bytes - heap_key_bytes
+    size_t          free_records;
+
+    tree_counters_t counters;
+} tree_stats_t;
+
+/*
+    One preorder pass over nodes plus one over the slab free list, counters
+    are copied as they are and stay zero without __TREE_STATS__
+*/
+err_t tree_stats(const tree_t * const tree, tree_stats_t * const out);
+
+err_t tree_print_node(const node_t * const node);
 err_t tree_print     (const tree_t * const tree);
 
-err_t tree_delete_node(node_t * node, size_t iter);
-err_t tree_clear      (const tree_t * const tree);
+err_t tree_delete_node(tree_t * const tree, node_t * node);
+err_t tree_clear      (tree_t * const tree);
+
+typedef err_t (*tree_visit_t)(node_t * const node, void * const ctx);
+
+/*
+    Keys are ordered by their decimal value (atoi), equal values by bytes
+*/
+void  tree_key_parse  (const char * const str, tree_key_t * const key);
+void  tree_key_parse_n(const char * const str, const size_t len, tree_key_t * const key);
+int   tree_key_cmp    (const char * const a, const char * const b);
+
+// Order of two parsed keys, the strings are read only on long prefix ties
+static inline int tree_key_compare(const tree_key_t* a, const char* a_str,
+                                   const tree_key_t* b, const char* b_str)
+{
+    if (a->num    != b->num)    return (a->num    < b->num)    ? -1 : 1;
+    if (a->prefix != b->prefix) return (a->prefix < b->prefix) ? -1 : 1;
+
+    const size_t packed = sizeof(a->prefix);
+    if (a->len <= packed || b->len <= packed)
+        return (a->len > b->len) - (a->len < b->len);
+    return strcmp(a_str + packed, b_str + packed);
+}
+
+/*
+    Leaf node for the key->len bytes of data, carved from the tree slab,
+    data needs no terminating zero
+*/
+node_t* tree_node_new (tree_t * const tree, const char * const data, const tree_key_t * const key);
 
 err_t tree_insert     (tree_t * const tree, const tree_elem_t data);
+err_t tree_find       (const tree_t * const tree, const char * const key, node_t ** const found);
+
+/*
+    out[i] is the node of keys[i] or NULL. Up to 16 lookups advance in
+    lockstep, each one prefetching its next node, so their cache misses
+    overlap instead of queueing behind each other
+*/
+err_t tree_find_batch(const tree_t * const tree, const char * const * const keys,
+                      const size_t n, node_t ** const out);
+
+err_t tree_lower_bound(const tree_t * const tree, const char * const key, node_t ** const found);
+err_t tree_upper_bound(const tree_t * const tree, const char * const key, node_t ** const found);
+err_t tree_delete     (tree_t * const tree, const char * const key);
+err_t tree_foreach    (const tree_t * const tree, tree_visit_t visit, void * const ctx);
+
+/*
+    Visit nodes with lo <= key <= hi in order, a NULL bound is open. Stops
+    at the first visit result other than OK and returns it
+*/
+err_t tree_range      (const tree_t * const tree, const char * const lo, const char * const hi,
+                       tree_visit_t visit, void * const ctx);
+
+/*
+    Replace tree contents with n keys (sorted first if they are not), nodes
+    are carved in one block in key order and linked as a perfectly balanced tree.
+    On failure the tree is left as it was
+*/
+err_t tree_build_from_array(tree_t * const tree, const char * const * const keys, const size_t n);
 
 #endif
@@ -0,0 +1,40 @@
+#include "alloc.h"
+
+void* mem_alloc(const allocator_t * const allocator, const size_t size)
+{
+    if (allocator == NULL) return malloc(size);
+    return allocator->alloc(allocator->ctx, size);
+}
+
+void* mem_calloc(const allocator_t * const allocator, const size_t amount, const size_t size)
+{
+    if (allocator == NULL) return calloc(amount, size);
+    if (size != 0 && amount > SIZE_MAX / size) return NULL;
+
+    void* ptr = allocator->alloc(allocator->ctx, amount * size);
+    if (ptr) memset(ptr, 0, amount * size);
+    return ptr;
+}
+
+void* mem_realloc(const allocator_t * const allocator, void* ptr,
+                  const size_t old_size, const size_t new_size)
+{
+    if (allocator == NULL) return realloc(ptr, new_size);
+    if (allocator->realloc) return allocator->realloc(allocator->ctx, ptr, old_size, new_size);
+
+    void* moved = allocator->alloc(allocator->ctx, new_size);
+    if (!moved) return NULL;
+    if (ptr)
+    {
+        memcpy(moved, ptr, old_size < new_size ? old_size : new_size);
+        if (allocator->free) allocator->free(allocator->ctx, ptr, old_size);
+    }
+    return moved;
+}
+
+void mem_free(const allocator_t * const allocator, void* ptr, const size_t size)
+{
+    if (ptr == NULL) return;
+    if (allocator == NULL) { free(ptr); return; }
+    if (allocator->free) allocator->free(allocator->ctx, ptr, size);
+}
@@ -0,0 +1,43 @@
+#ifndef ALLOC_H
+#define ALLOC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+    Allocator vtable. Every callback gets the user context back, realloc and
+    free also get the size of the block so that arenas and pools don't have
+    to keep headers. A NULL allocator_t pointer means plain libc heap
+*/
+typedef struct
+{
+    void* (*alloc)  (void* ctx, size_t size);
+    void* (*realloc)(void* ctx, void* ptr, size_t old_size, size_t new_size);
+    void  (*free)   (void* ctx, void* ptr, size_t size);
+    void*   ctx;
+} allocator_t;
+
+/*
+    Allocate size bytes through allocator (NULL - libc)
+*/
+void* mem_alloc  (const allocator_t * const allocator, const size_t size);
+
+/*
+    Allocate zeroed array of amount elements of size bytes, checks overflow
+*/
+void* mem_calloc (const allocator_t * const allocator, const size_t amount, const size_t size);
+
+/*
+    Resize block ptr of old_size bytes to new_size bytes
+*/
+void* mem_realloc(const allocator_t * const allocator, void* ptr,
+                  const size_t old_size, const size_t new_size);
+
+/*
+    Release block ptr of size bytes, NULL ptr is ignored
+*/
+void  mem_free   (const allocator_t * const allocator, void* ptr, const size_t size);
+
+#endif
@@ -1,5 +1,7 @@
 #include "io.h"
 
+#include <sys/mman.h>
+
 size_t parse_arguments(const int argc, char* const argv[],          \
                        const char** in_file, const char** out_file)
 {
@@ -98,3 +100,28 @@ size_t clean_file(const char * const filename)
     fclose(file_out);
     return 1;
 }
+
+char *map_file(FILE *file, size_t * const size)
+{
+    if (!CHECK(ERROR, file != NULL && size != NULL, "No file to map")) return NULL;
+    *size = 0;
+
+    struct stat st = { 0 };
+    if (fstat(fileno(file), &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0) return NULL;
+
+    void* data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+    if (data == MAP_FAILED)
+    {
+        log_printf(WARN, "Can't map file of %zu bytes", (size_t)st.st_size);
+        return NULL;
+    }
+
+    (void)madvise(data, (size_t)st.st_size, MADV_SEQUENTIAL);
+    *size = (size_t)st.st_size;
+    return (char*)data;
+}
+
+void unmap_file(char *data, const size_t size)
+{
+    if (data != NULL) munmap(data, size);
+}
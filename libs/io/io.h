@@ -44,4 +44,12 @@ ssize_t get_file_size_stat (const char * const filename);
 
 size_t clean_file(const char * const filename);
 
+/*
+    Function to map the whole file read-only, NULL if it can't be mapped
+    (empty file, pipe, terminal)
+*/
+char   *map_file  (FILE *file, size_t * const size);
+
+void    unmap_file(char *data, const size_t size);
+
 #endif
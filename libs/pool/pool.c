@@ -0,0 +1,233 @@
+#include "pool.h"
+
+#include <sched.h>
+#include <unistd.h>
+
+static bool deque_push(pool_worker_t * const w, const pool_task_t * const task)
+{
+    pthread_mutex_lock(&w->lock);
+
+    if (w->amount == w->capacity)
+    {
+        const size_t new_capacity = w->capacity ? w->capacity * 2 : POOL_DEQUE_START;
+        pool_task_t* tasks = (pool_task_t*)mem_calloc(w->pool->allocator, new_capacity,
+                                                      sizeof(pool_task_t));
+        if (tasks == NULL)
+        {
+            pthread_mutex_unlock(&w->lock);
+            return false;
+        }
+
+        for (size_t i = 0; i < w->amount; ++i)
+            tasks[i] = w->tasks[(w->head + i) % w->capacity];
+        mem_free(w->pool->allocator, w->tasks, w->capacity * sizeof(pool_task_t));
+
+        w->tasks    = tasks;
+        w->head     = 0;
+        w->capacity = new_capacity;
+    }
+
+    w->tasks[(w->head + w->amount) % w->capacity] = *task;
+    w->amount += 1;
+
+    pthread_mutex_unlock(&w->lock);
+    return true;
+}
+
+static bool deque_pop(pool_worker_t * const w, pool_task_t * const task, const bool steal)
+{
+    pthread_mutex_lock(&w->lock);
+
+    const bool found = w->amount > 0;
+    if (found && steal)
+    {
+        *task = w->tasks[w->head];
+        w->head = (w->head + 1) % w->capacity;
+        w->amount -= 1;
+    }
+    else if (found)
+    {
+        w->amount -= 1;
+        *task = w->tasks[(w->head + w->amount) % w->capacity];
+    }
+
+    pthread_mutex_unlock(&w->lock);
+    return found;
+}
+
+static bool find_task(pool_worker_t * const self, pool_task_t * const task)
+{
+    if (deque_pop(self, task, false)) return true;
+
+    pool_t* pool = self->pool;
+    const size_t n = pool->workers_amount;
+
+    // xorshift picks where to start so thieves don't all hit the same victim
+    self->seed ^= self->seed << 13;
+    self->seed ^= self->seed >> 7;
+    self->seed ^= self->seed << 17;
+
+    const size_t start = (size_t)(self->seed % n);
+    for (size_t i = 0; i < n; ++i)
+    {
+        pool_worker_t* victim = &pool->workers[(start + i) % n];
+        if (victim != self && deque_pop(victim, task, true)) return true;
+    }
+    return false;
+}
+
+static void task_finished(pool_t * const pool)
+{
+    if (atomic_fetch_sub(&pool->pending, 1) == 1)
+    {
+        pthread_mutex_lock(&pool->lock);
+        pthread_cond_broadcast(&pool->done);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+static void* worker_main(void* arg)
+{
+    pool_worker_t* self = (pool_worker_t*)arg;
+    pool_t*        pool = self->pool;
+    size_t         seen = 0;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&pool->lock);
+        while (!pool->stop && pool->generation == seen)
+            pthread_cond_wait(&pool->wake, &pool->lock);
+        seen = pool->generation;
+        const bool stop = pool->stop;
+        pthread_mutex_unlock(&pool->lock);
+
+        if (stop) return NULL;
+
+        pool_task_t task;
+        while (atomic_load(&pool->pending) > 0)
+        {
+            if (find_task(self, &task))
+            {
+                task.fn(self, task.ctx, task.arg);
+                task_finished(pool);
+            } else {
+                sched_yield();
+            }
+        }
+    }
+}
+
+err_t pool_ctor(pool_t * const pool, size_t threads, const allocator_t * const allocator)
+{
+    if (!CHECK(ERROR, pool != NULL, "pool_ctor: pool is NULL"))
+        return ERR_BAD_ARG;
+
+    if (threads == 0)
+    {
+        const long online = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = (online > 0) ? (size_t)online : 1;
+    }
+
+    *pool = (pool_t){ 0 };
+    pool->allocator = allocator;
+    atomic_init(&pool->pending, 0);
+
+    pool->workers = (pool_worker_t*)mem_calloc(allocator, threads, sizeof(pool_worker_t));
+    if (!CHECK(ERROR, pool->workers != NULL, "pool_ctor: workers alloc failed (%zu)", threads))
+        return ERR_ALLOC;
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init (&pool->wake, NULL);
+    pthread_cond_init (&pool->done, NULL);
+
+    for (size_t i = 0; i < threads; ++i)
+    {
+        pool_worker_t* w = &pool->workers[i];
+        w->pool  = pool;
+        w->index = i;
+        w->seed  = 0x9E3779B97F4A7C15ull * (i + 1);
+        pthread_mutex_init(&w->lock, NULL);
+
+        if (!CHECK(ERROR, pthread_create(&w->thread, NULL, worker_main, w) == 0,
+                   "pool_ctor: failed to start worker %zu", i))
+        {
+            pthread_mutex_destroy(&w->lock);
+            pool->workers_amount = i;
+            (void)pool_dtor(pool);
+            return ERR_ALLOC;
+        }
+        pool->workers_amount = i + 1;
+    }
+    return OK;
+}
+
+err_t pool_dtor(pool_t * const pool)
+{
+    if (!CHECK(ERROR, pool != NULL, "pool_dtor: pool is NULL"))
+        return ERR_BAD_ARG;
+
+    if (pool->workers == NULL) return OK;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = true;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    // Late thieves may still touch any deque, so join everyone first
+    for (size_t i = 0; i < pool->workers_amount; ++i)
+        pthread_join(pool->workers[i].thread, NULL);
+
+    for (size_t i = 0; i < pool->workers_amount; ++i)
+    {
+        pool_worker_t* w = &pool->workers[i];
+        pthread_mutex_destroy(&w->lock);
+        mem_free(pool->allocator, w->tasks, w->capacity * sizeof(pool_task_t));
+    }
+
+    pthread_cond_destroy (&pool->done);
+    pthread_cond_destroy (&pool->wake);
+    pthread_mutex_destroy(&pool->lock);
+
+    mem_free(pool->allocator, pool->workers, pool->workers_amount * sizeof(pool_worker_t));
+    pool->workers        = NULL;
+    pool->workers_amount = 0;
+    return OK;
+}
+
+err_t pool_run(pool_t * const pool, pool_fn_t fn, void * const ctx,
+               void * const arg0, void * const arg1, void * const arg2)
+{
+    if (!CHECK(ERROR, pool != NULL && pool->workers_amount > 0 && fn != NULL, "pool_run: bad args"))
+        return ERR_BAD_ARG;
+
+    const pool_task_t root = { fn, ctx, { arg0, arg1, arg2 } };
+
+    atomic_store(&pool->pending, 1);
+    if (!deque_push(&pool->workers[0], &root))
+    {
+        atomic_store(&pool->pending, 0);
+        return ERR_ALLOC;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->generation += 1;
+    pthread_cond_broadcast(&pool->wake);
+    while (atomic_load(&pool->pending) > 0)
+        pthread_cond_wait(&pool->done, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+
+    return OK;
+}
+
+void pool_spawn(pool_worker_t * const self, pool_fn_t fn, void * const ctx,
+                void * const arg0, void * const arg1, void * const arg2)
+{
+    const pool_task_t task = { fn, ctx, { arg0, arg1, arg2 } };
+
+    atomic_fetch_add(&self->pool->pending, 1);
+    if (!deque_push(self, &task))
+    {
+        fn(self, ctx, task.arg);
+        task_finished(self->pool);
+    }
+}
@@ -0,0 +1,79 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include "../logging/logging.h"
+#include "../alloc/alloc.h"
+#include "../types.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#define POOL_DEQUE_START 64
+
+struct pool_worker_t;
+
+typedef void (*pool_fn_t)(struct pool_worker_t * const self, void * const ctx, void * const arg[3]);
+
+typedef struct
+{
+    pool_fn_t fn;
+    void*     ctx;
+    void*     arg[3];
+} pool_task_t;
+
+/*
+    Worker with its own deque: the owner pushes and pops at the bottom,
+    idle workers steal from the top
+*/
+typedef struct pool_worker_t
+{
+    struct pool_t*  pool;
+    size_t          index;
+    pthread_t       thread;
+    uint64_t        seed;
+
+    pthread_mutex_t lock;
+    pool_task_t*    tasks;
+    size_t          head;
+    size_t          amount;
+    size_t          capacity;
+} pool_worker_t;
+
+/*
+    Fork-join work-stealing pool. pool_run hands one root task to the
+    workers and returns once it and everything it spawned has finished
+*/
+typedef struct pool_t
+{
+    pool_worker_t*     workers;
+    size_t             workers_amount;
+    const allocator_t* allocator;
+
+    pthread_mutex_t    lock;
+    pthread_cond_t     wake;
+    pthread_cond_t     done;
+    size_t             generation;
+    bool               stop;
+
+    atomic_size_t      pending;
+} pool_t;
+
+/*
+    Start threads workers (0 - one per online CPU)
+*/
+err_t pool_ctor(pool_t * const pool, size_t threads, const allocator_t * const allocator);
+err_t pool_dtor(pool_t * const pool);
+
+err_t pool_run  (pool_t * const pool, pool_fn_t fn, void * const ctx,
+                 void * const arg0, void * const arg1, void * const arg2);
+
+/*
+    Queue a task on the calling worker, it runs inline if the deque can't grow
+*/
+void  pool_spawn(pool_worker_t * const self, pool_fn_t fn, void * const ctx,
+                 void * const arg0, void * const arg1, void * const arg2);
+
+#endif
@@ -8,10 +8,11 @@
 
 typedef enum 
 {
-    OK          = 0,
-    ERR_BAD_ARG = 1,
-    ERR_CORRUPT = 2,
-    ERR_ALLOC   = 3,
+    OK            = 0,
+    ERR_BAD_ARG   = 1,
+    ERR_CORRUPT   = 2,
+    ERR_ALLOC     = 3,
+    ERR_NOT_FOUND = 4,
 } err_t;
 
 #endif
@@ -101,9 +101,9 @@ void test_list()
 }
 
 #define SET_NODE_VALUES(node, idata, ileft, iright) \
-    (node)->data  = (idata);  \
-    (node)->left  = (ileft);  \
-    (node)->right = (iright); \
+    node_set_data((node), (idata), NULL); \
+    (node)->left  = (ileft);              \
+    (node)->right = (iright);             \
 
 void test_tree()
 {